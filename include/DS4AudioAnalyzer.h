@@ -0,0 +1,83 @@
+#ifndef DS4_AUDIOANALYZER_H
+#define DS4_AUDIOANALYZER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "DS4SeqLock.h"
+
+using namespace std;
+
+static const int DS4_AUDIO_MAX_BANDS = 16;
+
+struct DS4AudioSettings
+{
+	size_t FftSize = 2048;
+	size_t WindowSize = 1024;
+	size_t HopSize = 512;
+	float Smoothing = 0.5f;				//per-bin magnitude smoothing, as MonitorSpectralNode
+	vector<float> BandEdges;			//Hz, n edges make n-1 bands, empty uses the defaults
+	float LoudnessAttack = 0.5f;
+	float LoudnessRelease = 0.05f;
+	float OnsetThreshold = 1.5f;		//flux over this multiple of its recent mean is an onset
+	float OnsetInterval = 0.2f;			//seconds, onsets closer than this are merged
+};
+
+// What the main thread reads each frame. Level is the same scaled mean
+// magnitude the app used to compute from MonitorSpectralNode, so spawn_level
+// keeps its meaning.
+struct DS4AudioFeatures
+{
+	float Level;
+	float Loudness;						//Level with attack/release smoothing
+	float Bands[DS4_AUDIO_MAX_BANDS];	//mean scaled magnitude per band
+	int BandCount;
+	float Flux;							//positive spectral change since the last block
+	uint32_t OnsetCount;				//increments on every onset, compare with the last value read
+	uint64_t BlockCount;
+};
+
+// Spectrum, band energy, loudness and onset analysis over a mono sample
+// stream. process() is meant for the audio callback: it never locks or
+// allocates, and results are published through a seqlock so getFeatures()
+// is a small copy on any thread.
+class DS4AudioAnalyzer
+{
+public:
+	DS4AudioAnalyzer();
+
+	// Allocates everything process() needs, not safe while process() runs
+	void setup(float pSampleRate, const DS4AudioSettings &pSettings);
+	void process(const float *pSamples, size_t pCount);
+
+	DS4AudioFeatures getFeatures() const { return mFeatures.load(); }
+	float getSampleRate() const { return mSampleRate; }
+
+private:
+	void analyze();
+	void fft();
+
+	float mSampleRate;
+	DS4AudioSettings mSettings;
+
+	vector<float> mHistory;				//last WindowSize samples, circular
+	size_t mHistoryPos, mSinceAnalysis;
+	vector<float> mWindow;
+	vector<float> mReal, mImag;
+	vector<float> mCos, mSin;
+	vector<uint32_t> mBitReverse;
+	vector<float> mMagnitudes, mPrevMagnitudes;
+	vector<int> mBandBins;				//first bin of each band, plus one past the last
+
+	vector<float> mFluxHistory;
+	size_t mFluxPos;
+	float mLoudness;
+	uint32_t mOnsetCount;
+	uint64_t mBlockCount, mLastOnsetBlock;
+
+	DS4SeqLock<DS4AudioFeatures> mFeatures;
+};
+
+// Reads a 16-bit PCM or 32-bit float WAV file, mixed down to mono
+bool DS4LoadWav(const string &pPath, vector<float> &pSamples, float &pSampleRate);
+#endif
@@ -0,0 +1,28 @@
+#ifndef DS4_AUDIOANALYZERNODE_H
+#define DS4_AUDIOANALYZERNODE_H
+
+#include "cinder/audio/Node.h"
+#include "DS4AudioAnalyzer.h"
+
+using namespace ci;
+
+// Feeds the first input channel to a DS4AudioAnalyzer on the audio thread.
+// Auto-pulled like MonitorNode, so it only needs an input connection.
+class DS4AudioAnalyzerNode : public audio::NodeAutoPullable
+{
+public:
+	DS4AudioAnalyzerNode(const DS4AudioSettings &pSettings, const Format &pFormat = Format());
+
+	DS4AudioFeatures getFeatures() const { return mAnalyzer.getFeatures(); }
+
+protected:
+	void initialize() override;
+	void process(audio::Buffer *pBuffer) override;
+
+private:
+	DS4AudioSettings mSettings;
+	DS4AudioAnalyzer mAnalyzer;
+};
+
+typedef shared_ptr<DS4AudioAnalyzerNode> DS4AudioAnalyzerNodeRef;
+#endif
@@ -0,0 +1,49 @@
+#ifndef DS4_CVPIPELINE_H
+#define DS4_CVPIPELINE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "DS4DepthProcessor.h"
+
+// Runs DS4DepthProcessor::process() on its own thread, one frame behind the
+// caller. submit() hands over frame N and returns the result for frame N-1,
+// so CV for the next frame overlaps drawing the current one. At most one
+// frame is in flight: if the previous frame is still being processed,
+// submit() waits for it, so results are always exactly one frame old and
+// never queue up.
+class DS4CVPipeline
+{
+public:
+	DS4CVPipeline();
+	~DS4CVPipeline();
+
+	// pProcessor must be setup() already and is owned by the pipeline thread
+	// until stop()
+	void start(DS4DepthProcessor *pProcessor);
+	void stop();
+	bool isRunning() const { return mProcessor != nullptr; }
+
+	// Copies pDepth, returns the previous frame's result (null on the first)
+	DS4FrameResultRef submit(const uint16_t *pDepth, const DS4CVParams &pParams, uint64_t pFrameNumber);
+
+private:
+	DS4CVPipeline(const DS4CVPipeline&);
+	DS4CVPipeline& operator=(const DS4CVPipeline&);
+
+	void waitIdle(unique_lock<mutex> &pLock);
+	void processLoop();
+
+	DS4DepthProcessor *mProcessor;
+	thread mThread;
+	mutex mMutex;
+	condition_variable mJobCond, mDoneCond;
+
+	vector<uint16_t> mDepth;
+	DS4CVParams mParams;
+	uint64_t mFrameNumber;
+	bool mHasJob, mQuit;
+	DS4FrameResultRef mResult;
+};
+#endif
@@ -0,0 +1,60 @@
+#ifndef DS4_CAPTURETHREAD_H
+#define DS4_CAPTURETHREAD_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "DS4DepthSource.h"
+#include "DS4TripleBuffer.h"
+
+struct DS4DepthFrame
+{
+	vector<uint16_t> Pixels;
+	double Time;
+	uint64_t FrameNumber;
+};
+
+// Runs another depth source's grab() loop on its own thread and hands the
+// newest complete frame to the app through a triple buffer, so a slow or
+// late USB transfer never stalls update(). grab() does not block: it returns
+// true when a newer frame has arrived since the last call, false otherwise.
+class DS4CaptureThread : public DS4DepthSource
+{
+public:
+	explicit DS4CaptureThread(DS4DepthSourceRef pSource);
+	~DS4CaptureThread();
+
+	bool startCapture();
+	void stopCapture();
+	bool isZEnabled() { return mZEnabled; }
+	bool grab();
+	uint16_t* getZImage();
+	Vec2i getZSize() { return mSize; }
+	bool getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics);
+
+	double getFrameTime() { return mFrames.getFront().Time; }
+	uint64_t getFrameNumber() { return mFrames.getFront().FrameNumber; }
+	string getName() { return mSource->getName() + " (capture thread)"; }
+
+	// Frames grabbed by the capture thread, frames it replaced before the app
+	// took them, and grab() calls that found no new frame
+	uint64_t getFramesCaptured() const { return mFramesCaptured; }
+	uint64_t getFramesDropped() const { return mFramesDropped; }
+	uint64_t getFramesRepeated() const { return mFramesRepeated; }
+
+private:
+	void captureLoop();
+
+	DS4DepthSourceRef mSource;
+	Vec2i mSize;
+	bool mZEnabled;
+	bool mHasIntrinsics;
+	DSCalibIntrinsicsRectified mIntrinsics;
+
+	DS4TripleBuffer<DS4DepthFrame> mFrames;
+	thread mThread;
+	atomic<bool> mQuit;
+	atomic<uint64_t> mFramesCaptured, mFramesDropped;
+	uint64_t mFramesRepeated;
+};
+#endif
@@ -0,0 +1,34 @@
+#ifndef DS4_DSAPISOURCE_H
+#define DS4_DSAPISOURCE_H
+
+#include "DSAPI.h"
+#include "DS4DepthSource.h"
+
+typedef shared_ptr<DSAPI> DSAPIRef;
+
+// Live depth from a DS4 camera through DSAPI.
+class DS4DSAPISource : public DS4DepthSource
+{
+public:
+	DS4DSAPISource(Vec2i pSize, int pFPS);
+
+	bool startCapture();
+	void stopCapture();
+	bool isZEnabled();
+	bool grab();
+	uint16_t* getZImage();
+	Vec2i getZSize() { return mSize; }
+	bool getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics);
+
+	double getFrameTime() { return mFrameTime; }
+	uint64_t getFrameNumber() { return mFrameNumber; }
+	string getName() { return "DSAPI"; }
+
+private:
+	DSAPIRef mDSAPI;
+	Vec2i mSize;
+	int mFPS;
+	double mFrameTime;
+	uint64_t mFrameNumber;
+};
+#endif
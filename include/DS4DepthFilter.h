@@ -0,0 +1,36 @@
+#ifndef DS4_DEPTHFILTER_H
+#define DS4_DEPTHFILTER_H
+
+#include <cstdint>
+#include <vector>
+#include "cinder/Vector.h"
+
+using namespace ci;
+using namespace std;
+
+// Temporal filter for the raw Z image, run ahead of the threshold so sensor
+// noise doesn't flicker the mask. Per pixel, against the last filtered value:
+//  - within pSnap mm it moves pAlpha of the way to the new reading, so
+//    jitter is smoothed while slow motion still comes through
+//  - further than pSnap it takes the new reading as is, so real motion is
+//    never delayed
+//  - a dropout (0) holds the last value for up to pHoleFrames frames
+// The filtered image is kept between calls; apply() returns it. The SSE2
+// and scalar paths give identical results.
+class DS4DepthFilter
+{
+public:
+	DS4DepthFilter();
+
+	void setup(Vec2i pSize);
+	// The next apply() passes its input straight through
+	void reset() { mIsPrimed = false; }
+	const uint16_t* apply(const uint16_t *pDepth, float pAlpha, int pSnap, int pHoleFrames);
+
+private:
+	Vec2i mSize;
+	bool mIsPrimed;
+	vector<uint16_t> mDepth;
+	vector<uint16_t> mHoleAges;	//frames each pixel has been held through a dropout
+};
+#endif
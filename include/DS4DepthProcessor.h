@@ -0,0 +1,181 @@
+#ifndef DS4_DEPTHPROCESSOR_H
+#define DS4_DEPTHPROCESSOR_H
+
+#include <cstdint>
+#include <vector>
+#include "cinder/Vector.h"
+#include "CinderOpenCV.h"
+#include "DSAPITypes.h"
+#include "DS4DepthFilter.h"
+#include "DS4FrameArena.h"
+#include "DS4Particle.h"
+#include "DS4RayTable.h"
+#include "DS4VoxelGrid.h"
+#include "DS4WorkerPool.h"
+
+using namespace ci;
+using namespace std;
+
+enum DS4CloudMode
+{
+	CLOUD_MODE_STRIDE = 0,	//every CloudRes-th pixel of every CloudRes-th row
+	CLOUD_MODE_VOXEL		//one averaged point per VoxelSize cube
+};
+
+// Per-frame settings for the depth pipeline, filled from the GUI params
+struct DS4CVParams
+{
+	int DepthMin, DepthMax;
+	double Thresh, SizeMin;
+	bool Denoise;		//temporal filter ahead of the threshold, opt-in
+	float DenoiseAlpha;
+	int DenoiseSnap, DenoiseHoleFrames;
+	int CloudMode;		//DS4CloudMode
+	float VoxelSize;	//mm, CLOUD_MODE_VOXEL only
+	int CloudRes, BoltRes, SpawnRes, FramesSpawn;
+	float LifeMin, LifeMax;	//particle lifetime in seconds
+	float ParticleAlpha, SpawnLevel;
+	float Level;		//audio level, spawning needs Level > SpawnLevel
+	bool IsDebug;		//debug view skips the cloud and spawning
+};
+
+enum DS4ContourPointFlag
+{
+	CONTOUR_POINT_PREV = 1,		//on the previous frame's mask
+	CONTOUR_POINT_CURRENT = 2	//on this frame's mask
+};
+
+// What the spawner and the debug view need to know about one contour
+struct DS4ContourInfo
+{
+	double Area;
+	cv::Rect Bounds;	//passing contours only
+	bool Passed;		//Area > SizeMin
+	size_t FlagsBegin;	//this contour's first entry in PointFlags, passing contours only
+};
+
+// Built once per frame by DS4DepthProcessor::analyzeContours(), one Contours
+// entry per contour in the same order. PointFlags holds DS4ContourPointFlag
+// bits for every point of every passing contour.
+struct DS4ContourAnalysis
+{
+	vector<DS4ContourInfo> Contours;
+	vector<uint8_t> PointFlags;
+};
+
+// Everything one processed frame hands to the renderer and the particle
+// system. Never modified while anyone outside the processor holds it, so the
+// render thread can keep one while the next frame is processed; the
+// processor's arena refills it once the last holder lets go.
+struct DS4FrameResult
+{
+	uint64_t FrameNumber;
+	DS4CVParams Params;
+	vector<Vec3f> CloudPoints;
+	vector<Vec3f> ContourPoints;
+	vector<Vec3f> BorderPoints;
+	vector<Vec3f> SpawnPoints;
+	vector<Vec3f> LongSpawnPoints;	//every 20th contour point, slower and longer lived
+	vector<vector<cv::Point>> Contours;
+	DS4ContourAnalysis Analysis;
+	vector<cv::Rect> DirtyRegions;
+	cv::Mat Mask, Diff;	//debug view only
+};
+
+typedef shared_ptr<const DS4FrameResult> DS4FrameResultRef;
+
+// The depth half of the old DS4ParticlesApp::updateCV(): optionally
+// denoises the Z image over time, quantizes and thresholds it in one lookup
+// table pass, builds the point cloud and border points, finds the motion
+// contours against the previous frame (only where the mask changed) and
+// collects bolt and spawn points along them. It needs no window, GL or audio
+// device, so the same code runs in the app and in DS4Bench. process() runs
+// the stages in order; they are public so callers can time them one by one.
+// Every buffer is kept from frame to frame, so once they have grown to the
+// scene a frame allocates nothing.
+class DS4DepthProcessor
+{
+public:
+	DS4DepthProcessor();
+	~DS4DepthProcessor();
+
+	void setup(Vec2i pSize, const DSCalibIntrinsicsRectified &pIntrinsics);
+	// Splits the cloud over pPool's threads, a null pool runs it on the caller
+	void setWorkerPool(DS4WorkerPoolRef pPool) { mWorkerPool = pPool; }
+	void process(const uint16_t *pDepth, const DS4CVParams &pParams, uint64_t pFrameNumber);
+
+	// Returns the filtered Z image, or pDepth when Denoise is off
+	const uint16_t* denoise(const uint16_t *pDepth, const DS4CVParams &pParams);
+	// Starts a frame: copies pDepth and writes the 8-bit depth image and the
+	// foreground mask in a single pass
+	void quantize(const uint16_t *pDepth, const DS4CVParams &pParams);
+	void buildCloud(const DS4CVParams &pParams);
+	void findContours();
+	// Areas, bounds and mask flags of the contours, for collectSpawns()
+	// and the debug view
+	void analyzeContours(const DS4CVParams &pParams);
+	void collectSpawns(const DS4CVParams &pParams, uint64_t pFrameNumber);
+
+	// Adds the collected spawn points to pSystem as particles
+	void emit(DS4ParticleSystem &pSystem, const DS4CVParams &pParams, uint64_t pFrameNumber);
+	static void emit(const vector<Vec3f> &pSpawnPoints, const vector<Vec3f> &pLongSpawnPoints, DS4ParticleSystem &pSystem, const DS4CVParams &pParams, uint64_t pFrameNumber);
+
+	// Swaps the last process()ed frame's points and contours into a recycled
+	// result, the getters below hold stale data until the next process()
+	DS4FrameResultRef takeResult(const DS4CVParams &pParams, uint64_t pFrameNumber);
+
+	Vec2i getSize() const { return mSize; }
+	const vector<Vec3f>& getCloudPoints() const { return mCloudPoints; }
+	const vector<Vec3f>& getContourPoints() const { return mContourPoints; }
+	const vector<Vec3f>& getBorderPoints() const { return mBorderPoints; }
+	const vector<Vec3f>& getSpawnPoints() const { return mSpawnPoints; }
+	const vector<Vec3f>& getLongSpawnPoints() const { return mLongSpawnPoints; }
+	const vector<vector<cv::Point>>& getContours() const { return mContours; }
+	const DS4ContourAnalysis& getContourAnalysis() const { return mAnalysis; }
+	const vector<cv::Rect>& getDirtyRegions() const { return mDirtyRegions; }
+	cv::Mat getMask() const { return mArena.getMaskMat(); }
+	cv::Mat getDepthImage() const { return cv::Mat(mSize.y, mSize.x, CV_8U(1), (void*)mDepthPixels.data()); }
+	cv::Mat getDiff() const { return mMatDiff; }
+
+private:
+	void updateDepthLut(const DS4CVParams &pParams);
+	void buildCloudRows(const DS4CVParams &pParams, int pStride, int pRowBegin, int pRowEnd, vector<Vec3f> &pPoints) const;
+	void findDirtyRegions();
+
+	Vec2i mSize;
+	DSCalibIntrinsicsRectified mZIntrinsics;
+	DS4RayTable mRays;
+	DS4DepthFilter mDepthFilter;
+	DS4FrameArena mArena;
+	vector<uint8_t> mDepthPixels;
+
+	// One entry per raw depth value: depth image byte in the low 8 bits,
+	// mask byte in the high 8. Rebuilt when the range or threshold changes.
+	vector<uint16_t> mDepthLut;
+	int mLutDepthMin, mLutDepthMax;
+	double mLutThresh;
+
+	cv::Mat mMatDiff;
+	vector<vector<cv::Point>> mContours;
+	DS4ContourAnalysis mAnalysis;
+
+	// Mask tiles that changed since the previous frame, and the
+	// non-overlapping regions around them that contours are traced in.
+	// The rest is findDirtyRegions() scratch.
+	vector<uint8_t> mDirtyTiles;
+	vector<cv::Rect> mDirtyRegions;
+	vector<uint8_t> mActiveTiles;
+	vector<cv::Rect> mTileBoxes;
+	vector<int> mTileStack;
+
+	vector<Vec3f> mCloudPoints;
+	vector<Vec3f> mContourPoints;
+	vector<Vec3f> mBorderPoints;
+	vector<Vec3f> mSpawnPoints;
+	vector<Vec3f> mLongSpawnPoints;
+
+	DS4WorkerPoolRef mWorkerPool;
+	vector<vector<Vec3f>> mBandPoints;
+	DS4VoxelGrid mVoxelGrid;
+};
+#endif
@@ -0,0 +1,141 @@
+#ifndef DS4_DEPTHRECORDING_H
+#define DS4_DEPTHRECORDING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "cinder/Vector.h"
+#include "DSAPITypes.h"
+
+using namespace ci;
+using namespace std;
+
+// .ds4r depth recordings.
+// Layout: DS4RecordingHeader, then one compressed payload per frame, then the
+// frame index (one DS4RecordingIndexEntry per frame, 8-byte aligned) and a
+// DS4RecordingFooter pointing back at it. Each frame is delta coded against
+// the previous frame (keyframes against zero), zigzagged and written as
+// varint zero-run/value pairs. Keyframes every KeyInterval frames bound the
+// decode work of a seek.
+struct DS4RecordingHeader
+{
+	char Magic[4];
+	uint32_t Version;
+	uint32_t Width, Height;
+	float FPS;
+	float Rfx, Rfy, Rpx, Rpy;
+	uint32_t KeyInterval;
+	uint32_t Reserved[6];
+};
+
+struct DS4RecordingIndexEntry
+{
+	uint64_t Offset;
+	uint64_t FrameNumber;
+	double Time;
+	uint32_t Size;
+	uint32_t IsKey;
+};
+
+struct DS4RecordingFooter
+{
+	uint64_t IndexOffset;
+	uint64_t FrameCount;
+	char Magic[8];
+};
+
+// Records frames on a background thread. push() copies the frame into a
+// preallocated slot and returns immediately; if the writer falls behind by
+// more than the queue depth the frame is dropped and counted instead of
+// stalling the caller.
+class DS4DepthRecorder
+{
+public:
+	DS4DepthRecorder();
+	~DS4DepthRecorder();
+
+	bool start(const string &pPath, Vec2i pSize, const DSCalibIntrinsicsRectified &pIntrinsics, float pFPS, uint32_t pKeyInterval = 60, size_t pQueueDepth = 16);
+	bool push(const uint16_t *pFrame, double pTime, uint64_t pFrameNumber);
+	void stop();
+
+	bool isRecording() const { return mIsRecording; }
+	uint64_t getFramesWritten() const { return mFramesWritten; }
+	uint64_t getFramesDropped() const { return mFramesDropped; }
+	uint64_t getBytesWritten() const { return mBytesWritten; }
+
+private:
+	struct Slot
+	{
+		vector<uint16_t> Pixels;
+		double Time;
+		uint64_t FrameNumber;
+	};
+
+	void writerLoop();
+	void writeFrame(const Slot &pSlot);
+
+	ofstream mFile;
+	Vec2i mSize;
+	uint32_t mKeyInterval;
+	bool mIsRecording;
+
+	vector<Slot> mSlots;
+	deque<size_t> mFree, mPending;
+	mutex mMutex;
+	condition_variable mCond;
+	thread mWriter;
+	bool mQuit;
+
+	vector<uint16_t> mPrevFrame;
+	vector<uint8_t> mEncoded;
+	vector<DS4RecordingIndexEntry> mIndex;
+	atomic<uint64_t> mFramesWritten, mFramesDropped, mBytesWritten;
+};
+
+// Opens a recording by memory mapping it; the frame index is read in place,
+// so opening costs the same regardless of recording length. readFrame() seeks
+// to any frame, decoding forward from the nearest keyframe unless the frame
+// directly follows the previous read.
+class DS4DepthRecordingReader
+{
+public:
+	DS4DepthRecordingReader();
+
+	bool open(const string &pPath);
+	void close();
+	bool isOpen() const { return mIndex != nullptr; }
+
+	size_t getFrameCount() const { return mFrameCount; }
+	Vec2i getSize() const { return Vec2i(mHeader.Width, mHeader.Height); }
+	float getFPS() const { return mHeader.FPS; }
+	uint32_t getKeyInterval() const { return mHeader.KeyInterval; }
+	DSCalibIntrinsicsRectified getIntrinsics() const;
+	const DS4RecordingIndexEntry& getEntry(size_t pFrame) const { return mIndex[pFrame]; }
+
+	bool readFrame(size_t pFrame, uint16_t *pPixels);
+
+private:
+	bool decode(size_t pFrame, uint16_t *pPixels);
+
+	boost::interprocess::file_mapping mMapping;
+	boost::interprocess::mapped_region mRegion;
+	const uint8_t *mData;
+	size_t mDataSize;
+
+	DS4RecordingHeader mHeader;
+	const DS4RecordingIndexEntry *mIndex;
+	size_t mFrameCount;
+
+	vector<uint16_t> mLastFrame;
+	size_t mLastDecoded;
+};
+#endif
@@ -0,0 +1,36 @@
+#ifndef DS4_DEPTHSOURCE_H
+#define DS4_DEPTHSOURCE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "cinder/Vector.h"
+#include "DSAPITypes.h"
+
+using namespace ci;
+using namespace std;
+
+// Anything that can hand the app 16-bit Z frames. The calls mirror the DSAPI
+// ones the app used directly: startCapture(), grab() then getZImage(). The
+// returned image stays valid until the next grab().
+class DS4DepthSource
+{
+public:
+	virtual ~DS4DepthSource() {}
+
+	virtual bool startCapture() = 0;
+	virtual void stopCapture() = 0;
+	virtual bool isZEnabled() = 0;
+	virtual bool grab() = 0;
+	virtual uint16_t* getZImage() = 0;
+	virtual Vec2i getZSize() = 0;
+	virtual bool getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics) = 0;
+
+	//Capture time in seconds and sequence number of the last grabbed frame
+	virtual double getFrameTime() = 0;
+	virtual uint64_t getFrameNumber() = 0;
+	virtual string getName() = 0;
+};
+
+typedef shared_ptr<DS4DepthSource> DS4DepthSourceRef;
+#endif
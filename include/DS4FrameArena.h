@@ -0,0 +1,71 @@
+#ifndef DS4_FRAMEARENA_H
+#define DS4_FRAMEARENA_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cinder/Vector.h"
+#include "CinderOpenCV.h"
+
+using namespace ci;
+using namespace std;
+
+struct DS4FrameResult;
+
+// Owns the depth pipeline's per-frame buffers so a frame in the steady state
+// makes no heap allocations. The depth and mask images come in current and
+// previous pairs that swap() exchanges by pointer at the start of a frame,
+// instead of copying this frame into the previous one at the end. Contour
+// point lists that drop out of use are parked rather than freed, and
+// results are recycled once every other holder has let go of them.
+class DS4FrameArena
+{
+public:
+	DS4FrameArena();
+	~DS4FrameArena();
+
+	// Zeroes both halves of each pair, so the first frame diffs against empty
+	void setup(Vec2i pSize);
+	// The current images become the previous ones, the old previous ones
+	// are handed out as current to be overwritten
+	void swap();
+
+	uint16_t* getDepth() { return mDepth[mCurrent].data(); }
+	const uint16_t* getDepth() const { return mDepth[mCurrent].data(); }
+	const uint16_t* getPrevDepth() const { return mDepth[1 - mCurrent].data(); }
+	uint8_t* getMask() { return mMask[mCurrent].data(); }
+	const uint8_t* getMask() const { return mMask[mCurrent].data(); }
+	const cv::Mat& getMaskMat() const { return mMaskMat[mCurrent]; }
+	const cv::Mat& getPrevMaskMat() const { return mMaskMat[1 - mCurrent]; }
+
+	// Sizes pContours to pCount lists. Lists past pCount are parked with
+	// their capacity, new ones are taken from the parked lists first.
+	void resizeContours(vector<vector<cv::Point>> &pContours, size_t pCount);
+
+	// Trace storage for cvFindContours, emptied with cvClearMemStorage
+	// so its blocks are reused
+	CvMemStorage* getContourStorage() const { return mContourStorage; }
+
+	// A result no one else holds, only allocates while the pool grows.
+	// Call from one thread only. The pool stays at two or three results only
+	// while a single consumer keeps at most the latest one (the app's
+	// mFrameResult, directly or through DS4CVPipeline). Each extra holder
+	// that keeps older results alive makes the pool grow by one result.
+	shared_ptr<DS4FrameResult> acquireResult();
+	size_t getResultCount() const { return mResults.size(); }
+
+private:
+	DS4FrameArena(const DS4FrameArena&);
+	DS4FrameArena& operator=(const DS4FrameArena&);
+
+	Vec2i mSize;
+	int mCurrent;
+	vector<uint16_t> mDepth[2];
+	vector<uint8_t> mMask[2];
+	cv::Mat mMaskMat[2];	//headers over mMask, no data of their own
+
+	vector<vector<cv::Point>> mSpareContours;
+	CvMemStorage *mContourStorage;
+	vector<shared_ptr<DS4FrameResult>> mResults;
+};
+#endif
@@ -0,0 +1,41 @@
+#ifndef DS4_GLPOINTBACKEND_H
+#define DS4_GLPOINTBACKEND_H
+
+#include "cinder/gl/gl.h"
+#include "DS4PointBackend.h"
+
+// The original path: one gl::vertex (and gl::color) call per point between
+// gl::begin and gl::end. Kept for drivers without glMapBufferRange.
+class DS4ImmediatePointBackend : public DS4PointBackend
+{
+public:
+	void drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize) override;
+	void drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize) override;
+	const char* getName() const override { return "immediate"; }
+};
+
+// Streams each layer into one GL_STREAM_DRAW buffer and draws it with a
+// single glDrawArrays. Layers are appended at increasing offsets through
+// unsynchronized glMapBufferRange, so the driver never waits on a range the
+// GPU may still be reading; when the buffer is full it is orphaned with
+// glBufferData(nullptr) and writing restarts at zero in fresh storage.
+class DS4StreamPointBackend : public DS4PointBackend
+{
+public:
+	explicit DS4StreamPointBackend(size_t pCapacity = 8 << 20);
+	~DS4StreamPointBackend();
+
+	void drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize) override;
+	void drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize) override;
+	const char* getName() const override { return "stream"; }
+
+private:
+	DS4StreamPointBackend(const DS4StreamPointBackend&);
+	DS4StreamPointBackend& operator=(const DS4StreamPointBackend&);
+
+	void submit(const Vec3f *pPoints, const ColorA *pColors, const ColorA &pColor, size_t pCount, float pPointSize);
+
+	GLuint mBuffer;
+	size_t mCapacity, mOffset;
+};
+#endif
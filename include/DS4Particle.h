@@ -1,45 +1,123 @@
 #ifndef DS4_PARTICLE_H
 #define DS4_PARTICLE_H
 
+#include <vector>
 #include "cinder/Vector.h"
 #include "cinder/Color.h"
-#include "cinder/Rand.h"
+#include "DS4ParticleKernels.h"
+#include "DS4PointBackend.h"
+#include "DS4Random.h"
+#include "DS4WorkerPool.h"
 
 using namespace ci;
 using namespace std;
+
+// One particle's starting state, as DS4ParticleSystem::add() takes it. The
+// system steps its own arrays, a DS4Particle is never stepped.
 class DS4Particle
 {
 public:
 	DS4Particle();
-	DS4Particle(Vec3f pPos, Vec3f pVel, int pAge, float pMaxAlpha, bool pIsMica);
+	DS4Particle(Vec3f pPos, Vec3f pVel, float pLife, float pAlpha, bool pIsMica);
 
-	void step();
+	float getAge() const { return mAge; }
+	float getLife() const { return mLife; }
+	const ColorA& getStartColor() const { return mStartColor; }
+	const ColorA& getEndColor() const { return mEndColor; }
 
-	bool IsActive, IsMica;
+	bool IsMica;
 	Vec3f PPosition;
 	Vec3f PVelocity;
 	ColorA PColor;
 
 private:
-	int mAge, mLife;
+	float mAge, mLife;	//seconds
 	ColorA mStartColor;
 	ColorA mEndColor;
 };
 
+// Ranges for DS4ParticleSystem::emit(), each particle draws uniformly from
+// every one of them
+struct DS4EmitParams
+{
+	Vec3f VelocityMin, VelocityMax;	//mm per second
+	Vec2f LifeRange;	//seconds, [x, y)
+	float AlphaMax;		//start alpha is drawn from [0.1, AlphaMax)
+	float MicaRatio;	//fraction of particles emitted as white mica flakes
+};
+
+// Random stream ids under the shared seed, one per consumer
+enum DS4RandomStream
+{
+	RANDOM_STREAM_PARTICLES = 0,
+	RANDOM_STREAM_PROFILING
+};
+
+// Particles are stored as a structure of arrays: each field lives in its own
+// contiguous array so step() and display() only stream the fields they touch.
+// The arrays are a fixed-capacity pool; live particles occupy [0, count()) and
+// expired ones are swapped with the last live particle at the start of the
+// next step(), so a particle is drawn on the frame it expires.
+// With a worker pool attached, integration runs in fixed-size chunks across
+// the pool and joins before step() returns, so results match the serial path.
+// step() advances by a fixed time and keeps the positions from before it, so
+// display() can draw any point between the last two steps.
 class DS4ParticleSystem
 {
 public:
 	DS4ParticleSystem();
 	~DS4ParticleSystem();
 
-	void step();
-	void display();
-	void add(Vec3f pPos, Vec3f pVel, Vec2i pAge, float pAlpha, bool pIsMica);
-	void add(DS4Particle pParticle);
-	inline size_t count() { return mParticles.size(); }
+	void setCapacity(size_t pCapacity);
+	// Caps how many particles may be live without reallocating, clamped to
+	// the capacity. Particles already past a lowered limit live out their
+	// lifetimes, new ones wait until the count drops under it.
+	void setLimit(size_t pLimit);
+	void setKernelLevel(DS4KernelLevel pLevel);
+	void setWorkerPool(DS4WorkerPoolRef pPool, size_t pChunkSize = 4096);
+	// Every random draw comes from this seed, so the same seed and the same
+	// spawn points give the same particles
+	void setSeed(uint64_t pSeed) { mRandom.seed(pSeed, RANDOM_STREAM_PARTICLES); }
+	DS4KernelLevel getKernelLevel() const { return mKernelLevel; }
+	void step(float pDt);
+	// pAlpha 0 draws the positions before the last step(), 1 the current ones
+	void display(DS4PointBackend &pBackend, float pPointSize, float pAlpha = 1.0f);
+	bool add(Vec3f pPos, Vec3f pVel, Vec2f pLife, float pAlpha, bool pIsMica);
+	bool add(DS4Particle pParticle);
+	// Fills the next free slots straight from pPositions, returns how many
+	// fit in the pool
+	size_t emit(const Vec3f *pPositions, size_t pCount, const DS4EmitParams &pParams);
+	void expire(size_t pCount);
+	inline size_t count() { return mCount; }
+	inline size_t capacity() { return mCapacity; }
+	inline size_t limit() { return mLimit; }
+	inline const Vec3f* getPositions() const { return mPositions.data(); }
+	inline const ColorA* getColors() const { return mColors.data(); }
 
 private:
-	vector<DS4Particle> mParticles;
+	DS4ParticleArrays getArrays();
+	void retire();
+	void interpolate(float pAlpha);
+
+	size_t mCount, mCapacity, mLimit;
+	DS4KernelLevel mKernelLevel;
+	DS4StepKernel mStepKernel;
+	DS4WorkerPoolRef mWorkerPool;
+	size_t mChunkSize;
+	DS4Random mRandom;
+
+	vector<Vec3f> mPositions;
+	vector<Vec3f> mPrevPositions;
+	vector<Vec3f> mDrawPositions;	//display() output between steps
+	vector<Vec3f> mVelocities;
+	vector<ColorA> mColors;
+	vector<ColorA> mStartColors;
+	vector<ColorA> mEndColors;
+	vector<float> mAges;
+	vector<float> mLives;
 
+	//emit() scratch, sized with the pool
+	vector<float> mEmitAlphas;
+	vector<float> mEmitMica;
 };
-#endif
\ No newline at end of file
+#endif
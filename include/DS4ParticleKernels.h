@@ -0,0 +1,47 @@
+#ifndef DS4_PARTICLEKERNELS_H
+#define DS4_PARTICLEKERNELS_H
+
+#include <cstddef>
+
+// Raw views of the DS4ParticleSystem arrays. Positions and velocities are
+// packed xyz triples, colors packed rgba quads, one entry per particle.
+// Ages and lives are in seconds, velocities in mm per second.
+struct DS4ParticleArrays
+{
+	float *Positions;
+	float *PrevPositions;
+	float *Velocities;
+	float *Colors;
+	const float *StartColors;
+	const float *EndColors;
+	float *Ages;
+	const float *Lives;
+};
+
+enum DS4KernelLevel
+{
+	KERNEL_SCALAR = 0,
+	KERNEL_SSE2,
+	KERNEL_AVX2
+};
+
+// Integrates particles [pBegin, pEnd) by pDt seconds: age -= pDt,
+// previous position = position, position += velocity * pDt,
+// velocity *= pDamping, color = lerp(end, start, max(age/life, 0)).
+// A particle whose age reaches zero keeps its position and velocity, so it
+// is drawn frozen in the end color until the next step retires it.
+// Every level performs the same IEEE operations in the same order, so the
+// SIMD kernels are bit-identical to the scalar one. The only exception is a
+// compiler contracting a scalar multiply-add into an FMA, which stays within
+// 1 ulp.
+typedef void(*DS4StepKernel)(const DS4ParticleArrays &pArrays, size_t pBegin, size_t pEnd, float pDt, float pDamping);
+
+DS4KernelLevel DS4GetBestKernelLevel();
+DS4StepKernel DS4GetStepKernel(DS4KernelLevel pLevel);
+const char* DS4GetKernelName(DS4KernelLevel pLevel);
+
+// Runs pCount synthetic particles through pLevel and the scalar kernel and
+// returns true when every output matches bit for bit and the particles that
+// expired along the way stayed put.
+bool DS4VerifyStepKernel(DS4KernelLevel pLevel, size_t pCount);
+#endif
@@ -1,34 +1,37 @@
 #ifndef DS4_PARTICLESAPP_H
 #define DS4_PARTICLESAPP_H
 
-#ifdef _DEBUG
-#pragma comment(lib, "DSAPI32.dbg.lib")
-#else
-#pragma comment(lib, "DSAPI32.lib")
-#endif
 #include <memory>
 #include <boost/program_options.hpp>
 #include "cinder/app/AppNative.h"
 #include "cinder/Arcball.h"
 #include "cinder/audio/Context.h"
-#include "cinder/audio/MonitorNode.h"
 #include "cinder/audio/Utilities.h"
 #include "cinder/Camera.h"
 #include "cinder/gl/gl.h"
 #include "cinder/gl/Texture.h"
 #include "cinder/MayaCamUI.h"
 #include "cinder/params/Params.h"
-#include "DSAPI.h"
+#include "cinder/Timer.h"
 #include "CinderOpenCV.h"
+#include "DS4AudioAnalyzerNode.h"
+#include "DS4CaptureThread.h"
+#include "DS4CVPipeline.h"
+#include "DS4DepthProcessor.h"
+#include "DS4DSAPISource.h"
+#include "DS4GLPointBackend.h"
 #include "DS4Particle.h"
+#include "DS4QualityGovernor.h"
+#include "DS4ReplaySource.h"
+#include "DS4SimClock.h"
+#include "DS4SoftRenderer.h"
+#include "DS4Trace.h"
 
 using namespace ci;
 using namespace ci::app;
 using namespace std;
 namespace bpo = boost::program_options;
 
-typedef shared_ptr<DSAPI> DSAPIRef;
-
 class DS4ParticlesApp : public AppNative
 {
 public:
@@ -43,38 +46,48 @@ public:
 	void shutdown();
 
 	const int NUM_COLORMODES = 4;
-	enum DS4PColorMode
-	{
-		COLOR_MODE_BLUE=0,	//all blue
-		COLOR_MODE_GOLD,	//all gold
-		COLOR_MODE_BLUE_P,	//blue
-		COLOR_MODE_GOLD_P,
-		COLOR_MODE_BLUE_P2
-	};
 
 private:
 	void setupGUI();
-	bool setupDSAPI();
+	bool setupDepthSource();
 	void setupScene();
 	void setupAudio();
 	void setupColors();
 
 	void updateCV();
+	DS4CVParams getCVParams();
 	void updateAudio();
+	void stepSimulation(double pElapsed);
+	void updateGovernor();
+	void updateDebugTexture(const cv::Mat &pImage, Channel8u &pChannel, gl::Texture &pTexture);
 
 	void drawDebug();
 	void drawRunning();
+	void drawPointLayers(DS4PointBackend &pBackend);
+	DS4PointLayerParams getPointLayerParams();
 	void drawCamInfo();
 
+	void renderSoftFrame();
+
+	void toggleRecording();
+	void reportStepScaling();
+	void dumpTrace();
+
 	void readConfig();
 	void writeConfig();
 
 	//Audio stuff
 	audio::InputDeviceNodeRef mInputDeviceNode;
-	audio::MonitorSpectralNodeRef mMonitorSpectralNode;
-	vector<float> mMagSpectrum;
+	DS4AudioAnalyzerNodeRef mAudioNode;
+	DS4AudioFeatures mAudioFeatures;
 	float mMagMean;
 
+	//WAV input, fed to mFileAnalyzer in real time instead of a device
+	DS4AudioAnalyzer mFileAnalyzer;
+	vector<float> mAudioFileSamples;
+	size_t mAudioFileFed;
+	Timer mAudioFileTimer;
+
 	//Colors
 	Color mIntelBlue;
 	Color mIntelPaleBlue;	
@@ -98,52 +111,88 @@ private:
 	gl::Texture mLogo;
 
 	//Point cloud
-	vector<Vec3f> mCloudPoints;
-	vector<Vec3f> mContourPoints;
-	vector<Vec3f> mBorderPoints;
+	DS4DepthProcessor mDepthProcessor;
+	DS4CVPipeline mCVPipeline;
+	DS4FrameResultRef mFrameResult;
 	DS4ParticleSystem mParticleSystem;
+	DS4SimClock mSimClock;
+	double mLastUpdateTime;
+
+	//Quality governor, mQuality is what this frame actually runs with
+	DS4QualityGovernor mGovernor;
+	DS4QualitySettings mQuality;
+	double mFrameCpuMs;
+	float mGovernorMs;
+	int mQualityLevel;
+	DS4WorkerPoolRef mWorkerPool;
+	DS4PointBackendRef mPointBackend;
+	DS4SoftRenderer mSoftRenderer;
+	bool mIsSoftRendering;
+	int mSoftFrame;
 
 	//DS
-	DSAPIRef mDSAPI;
+	DS4DepthSourceRef mDepthSource;
+	DS4DepthRecorder mRecorder;
 	DSCalibIntrinsicsRectified mZIntrinsics;
-	uint8_t *mDepthPixels, *mPrevDepthPixels;
-	uint16_t *mDepthBuffer, *mPrevDepthBuffer;
-
-	//OpenCV
-	cv::Mat mMatCurrent;
-	cv::Mat mMatPrev;
-	cv::Mat mMatDiff;
-	vector<vector<cv::Point>> mContours;
-	vector<vector<cv::Point>> mContoursKeep;
-	vector<cv::Vec4i> mHierarchy;
+	uint16_t *mDepthBuffer;
 
 	//Settings
 	params::InterfaceGlRef mGUI;
 	int mDepthMin,
 		mDepthMax,
+		mDenoiseSnap,
+		mDenoiseHoleFrames,
 		mFramesSpawn,
+		mCloudMode,
 		mCloudRes,
 		mSpawnRes,
 		mBoltRes,
-		mAgeMin,
-		mAgeMax,
-		mLogoSize;
+		mLogoSize,
+		mGovernorCloudResMax,
+		mGovernorSpawnResMax,
+		mGovernorBoltResMax,
+		mGovernorParticlesMin,
+		mGovernorSpawnRateMax;
 
 	int mNumParticles;
+	uint32_t mRandomSeed;	//0 picks one from the clock
 	double	mThresh,
 			mSizeMin;
 	float	mFPS,
+			mDenoiseAlpha,
+			mVoxelSize,
 			mPointSize,
 			mBoltWidthMin,
 			mBoltWidthMax,
 			mParticleSize,
+			mLifeMin,
+			mLifeMax,
+			mSimRate,
 			mSpawnLevel,
 			mBoltAlphaMin,
 			mBoltAlphaMax,
 			mParticleAlpha,
+			mOnsetThreshold,
 			mLogoAlpha,
-			mBGAlpha;
-	bool mIsDebug;
+			mBGAlpha,
+			mGovernorTarget;
+	bool mIsDebug,
+		mDenoise,
+		mGovernorOn;
+	string	mDepthSourceName,
+			mReplayPath,
+			mRecordPath,
+			mAudioFile,
+			mAudioBands,
+			mTracePath,
+			mRenderPath,
+			mPointBackendName;
+	bool	mReplayRealtime,
+			mReplayLoop,
+			mCaptureThread,
+			mPipelineCV,
+			mTraceOnExit;
+	Channel8u mChanBase, mChanBlob;	//debug view pixels, reused every frame
 	gl::Texture mTexBase;
 	gl::Texture mTexCountour;
 	gl::Texture mTexBlob;
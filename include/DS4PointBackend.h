@@ -0,0 +1,94 @@
+#ifndef DS4_POINTBACKEND_H
+#define DS4_POINTBACKEND_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cinder/Color.h"
+#include "cinder/Vector.h"
+
+using namespace ci;
+using namespace std;
+
+struct DS4PointStats
+{
+	size_t Draws;
+	size_t Vertices;
+	size_t Bytes;		//vertex data written for the GPU
+	size_t Orphans;		//times the stream buffer was reallocated
+
+	DS4PointStats() : Draws(0), Vertices(0), Bytes(0), Orphans(0) {}
+};
+
+// Where drawRunning()'s point layers go. Each call is one layer drawn as
+// additive GL_POINTS of one size, either in a single color or with a color
+// per point. The GL backends draw with whatever matrices and blending are
+// current; stats cover the calls since the last beginFrame().
+class DS4PointBackend
+{
+public:
+	virtual ~DS4PointBackend() {}
+
+	virtual void beginFrame() { mStats = DS4PointStats(); }
+	virtual void drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize) = 0;
+	virtual void drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize) = 0;
+	virtual const char* getName() const = 0;
+
+	const DS4PointStats& getStats() const { return mStats; }
+
+	// Bytes a stream backend writes for a layer: positions, then colors if any
+	static size_t getPackedSize(size_t pCount, bool pHasColors);
+	static void pack(uint8_t *pDst, const Vec3f *pPoints, const ColorA *pColors, size_t pCount);
+
+protected:
+	DS4PointStats mStats;
+};
+
+typedef shared_ptr<DS4PointBackend> DS4PointBackendRef;
+
+enum DS4PColorMode
+{
+	COLOR_MODE_BLUE=0,	//all blue
+	COLOR_MODE_GOLD,	//all gold
+	COLOR_MODE_BLUE_P,	//blue
+	COLOR_MODE_GOLD_P,
+	COLOR_MODE_BLUE_P2
+};
+
+// Sizes and palette of drawRunning()'s point layers, as the app's config
+// and GUI set them. Bolt width and alpha are mapped from the audio level.
+struct DS4PointLayerParams
+{
+	float PointSize;	//cloud
+	float ParticleSize;
+	float BoltWidthMin;
+	float BoltWidthMax;
+	float BoltAlphaMin;
+	float BoltAlphaMax;
+	DS4PColorMode ColorMode;
+};
+
+class DS4ParticleSystem;
+
+// Cloud, bolts and particles, one backend call per layer. The app and
+// DS4Bench's --render both draw through this so their frames match.
+void DS4DrawPointLayers(DS4PointBackend &pBackend, const DS4PointLayerParams &pParams, const vector<Vec3f> &pCloud, const vector<Vec3f> &pContour, const vector<Vec3f> &pBorder, DS4ParticleSystem &pParticles, float pLevel, float pSimAlpha);
+ColorA DS4GetCloudColor(DS4PColorMode pMode);
+ColorA DS4GetBoltColor(DS4PColorMode pMode, float pAlpha);
+
+// Null backend: packs every layer into a CPU buffer the way the stream
+// backend fills its mapped range, so submission cost and vertex counts can
+// be measured without a GL context.
+class DS4CountingPointBackend : public DS4PointBackend
+{
+public:
+	void drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize) override;
+	void drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize) override;
+	const char* getName() const override { return "counting"; }
+
+private:
+	void submit(const Vec3f *pPoints, const ColorA *pColors, size_t pCount);
+
+	vector<uint8_t> mStaging;
+};
+#endif
@@ -0,0 +1,57 @@
+#ifndef DS4_QUALITYGOVERNOR_H
+#define DS4_QUALITYGOVERNOR_H
+
+// The knobs the governor turns. Higher resolutions and spawn rates are
+// cheaper (fewer points, fewer spawn frames), a lower particle count is too.
+struct DS4QualitySettings
+{
+	int CloudRes, SpawnRes, BoltRes, ParticleCount, FramesSpawn;
+};
+
+struct DS4GovernorParams
+{
+	float TargetMs;				//CPU time per frame to hold
+	DS4QualitySettings Limits;	//cheapest value each knob may be taken to
+};
+
+// Holds the per-frame CPU time near a target by moving every knob between
+// the operator's settings (level 0) and the configured limits (max level)
+// in equal steps. Frame times are averaged over windows of S_WINDOW frames:
+//  - a window over the target by more than 10% raises the level at once
+//  - four windows in a row under 75% of the target lower it
+//  - anything between is the dead band and resets both counts
+// so a level is never raised and lowered on the same load. The window right
+// after a change is discarded while the new settings take effect.
+class DS4QualityGovernor
+{
+public:
+	static const int S_MAX_LEVEL = 8;
+	static const int S_WINDOW = 30;
+
+	DS4QualityGovernor();
+
+	// Starts over at level 0
+	void setup(const DS4GovernorParams &pParams);
+	void reset();
+	void setTarget(float pTargetMs) { mParams.TargetMs = pTargetMs; }
+	// Feeds one frame's CPU time, returns true when the level changed
+	bool addFrame(double pMs);
+	// pBase moved getLevel() steps toward the limits, never past pBase's own
+	// cheaper values
+	DS4QualitySettings apply(const DS4QualitySettings &pBase) const;
+
+	int getLevel() const { return mLevel; }
+	float getTargetMs() const { return mParams.TargetMs; }
+	// Mean of the last complete window
+	float getWindowMs() const { return mWindowMs; }
+
+private:
+	DS4GovernorParams mParams;
+	int mLevel;
+	int mUnderWindows;
+	bool mIsSettling;
+	double mWindowSum;
+	int mWindowFrames;
+	float mWindowMs;
+};
+#endif
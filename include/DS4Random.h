@@ -0,0 +1,37 @@
+#ifndef DS4_RANDOM_H
+#define DS4_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Seeded random numbers for the simulation, in place of Cinder's global
+// randFloat()/randInt(). Four xorshift128 generators run side by side, one
+// per SSE2 lane, and their outputs interleave into a single stream, so the
+// bulk fills step all four at once while next*() hands the same values out
+// one by one. The sequence depends only on the seed and stream id (never on
+// SSE2 being available or how calls are split between next and fill).
+// A DS4Random is not shared between threads: give each thread or owner its
+// own stream id under the same seed to get independent, reproducible streams.
+class DS4Random
+{
+public:
+	explicit DS4Random(uint64_t pSeed = 1, uint64_t pStream = 0);
+	void seed(uint64_t pSeed, uint64_t pStream = 0);
+
+	uint32_t nextUInt();
+	// [0, 1)
+	float nextFloat();
+	// pMin + (pMax - pMin) * [0, 1), like randFloat(pMin, pMax)
+	float nextFloat(float pMin, float pMax);
+
+	void fillFloats(float *pDst, size_t pCount, float pMin, float pMax);
+
+	static uint64_t splitMix64(uint64_t &pState);
+
+private:
+	void step();
+
+	uint32_t mX[4], mY[4], mZ[4], mW[4];
+	uint32_t mBlockPos;		//next unused lane of mW, 4 when all are used
+};
+#endif
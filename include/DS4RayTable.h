@@ -0,0 +1,41 @@
+#ifndef DS4_RAYTABLE_H
+#define DS4_RAYTABLE_H
+
+#include <vector>
+#include "cinder/Vector.h"
+#include "DSAPITypes.h"
+
+using namespace ci;
+using namespace std;
+
+// Deprojection rays for the rectified Z image. Pixel (x, y) has the ray
+// (x - rpx) / rfx, (y - rpy) / rfy, so deprojecting a pixel is one multiply
+// by Z instead of a DSTransformFromZImageToZCamera call. X is stored per
+// pixel in a row-major array so a row can be streamed (or loaded four at a
+// time) without shuffling; Y is constant along a row and stored once per row.
+class DS4RayTable
+{
+public:
+	DS4RayTable();
+
+	// Rebuilds the table if the size or intrinsics differ from the last
+	// build, returns true if it did
+	bool update(Vec2i pSize, const DSCalibIntrinsicsRectified &pIntrinsics);
+
+	const float* getRaysX(int pRow) const { return &mRaysX[pRow*mSize.x]; }
+	float getRayY(int pRow) const { return mRaysY[pRow]; }
+
+	// Camera space point for pixel (pX, pY) at depth pZ, same axes as
+	// DSTransformFromZImageToZCamera
+	Vec3f deproject(int pX, int pY, float pZ) const
+	{
+		return Vec3f(mRaysX[pY*mSize.x + pX] * pZ, mRaysY[pY] * pZ, pZ);
+	}
+
+private:
+	Vec2i mSize;
+	DSCalibIntrinsicsRectified mIntrinsics;
+	vector<float> mRaysX;
+	vector<float> mRaysY;	//one per row
+};
+#endif
@@ -0,0 +1,65 @@
+#ifndef DS4_REPLAYSOURCE_H
+#define DS4_REPLAYSOURCE_H
+
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "DS4DepthRecording.h"
+#include "DS4DepthSource.h"
+
+namespace bfs = boost::filesystem;
+
+// Plays back recorded Z frames, either from a .ds4r recording (see
+// DS4DepthRecording.h) or from a directory holding an intrinsics.cfg with the
+// DSCalibIntrinsicsRectified values plus frame rate, and one raw little-endian
+// uint16 file per frame, played in file name order.
+// SPEED_REALTIME paces grab() at the recorded frame rate; SPEED_MAX returns a
+// new frame on every grab(). With looping on, playback wraps to the first frame.
+class DS4ReplaySource : public DS4DepthSource
+{
+public:
+	enum ReplaySpeed
+	{
+		SPEED_REALTIME = 0,
+		SPEED_MAX
+	};
+
+	DS4ReplaySource(const bfs::path &pPath, ReplaySpeed pSpeed, bool pLoop);
+
+	bool startCapture();
+	void stopCapture();
+	bool isZEnabled() { return mIsRunning; }
+	bool grab();
+	uint16_t* getZImage() { return mFrame.data(); }
+	Vec2i getZSize() { return mSize; }
+	bool getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics);
+
+	double getFrameTime() { return mFrameTime; }
+	uint64_t getFrameNumber() { return mFrameNumber; }
+	string getName() { return "Replay " + mPath.string(); }
+
+	size_t getFrameCount() const { return mFrameCount; }
+
+	static bool writeIntrinsics(const bfs::path &pDir, const DSCalibIntrinsicsRectified &pIntrinsics, float pFPS);
+	static bool writeFrame(const bfs::path &pDir, size_t pIndex, const uint16_t *pPixels, Vec2i pSize);
+
+private:
+	bool readIntrinsics();
+	bool readFrame(size_t pIndex);
+	double getClock();
+
+	bfs::path mPath;
+	ReplaySpeed mSpeed;
+	bool mLoop, mIsRunning;
+
+	DSCalibIntrinsicsRectified mIntrinsics;
+	Vec2i mSize;
+	float mFPS;
+	vector<bfs::path> mFrameFiles;
+	DS4DepthRecordingReader mRecording;
+	size_t mFrameCount;
+	vector<uint16_t> mFrame;
+
+	uint64_t mNextFrame, mFrameNumber;
+	double mStartClock, mFrameTime;
+};
+#endif
@@ -0,0 +1,46 @@
+#ifndef DS4_SEQLOCK_H
+#define DS4_SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Single writer sequence lock for small plain structs. The writer never
+// waits; readers copy the value and retry if a write overlapped the copy, so
+// neither side takes a lock or allocates.
+template<typename T>
+class DS4SeqLock
+{
+public:
+	DS4SeqLock() { mSequence = 0; memset(&mValue, 0, sizeof(T)); }
+
+	void store(const T &pValue)
+	{
+		uint32_t cSequence = mSequence.load(memory_order_relaxed);
+		mSequence.store(cSequence + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		memcpy(&mValue, &pValue, sizeof(T));
+		mSequence.store(cSequence + 2, memory_order_release);
+	}
+
+	T load() const
+	{
+		T cValue;
+		uint32_t cBefore, cAfter;
+		do
+		{
+			cBefore = mSequence.load(memory_order_acquire);
+			memcpy(&cValue, &mValue, sizeof(T));
+			atomic_thread_fence(memory_order_acquire);
+			cAfter = mSequence.load(memory_order_relaxed);
+		} while ((cBefore & 1) || cBefore != cAfter);
+		return cValue;
+	}
+
+private:
+	atomic<uint32_t> mSequence;
+	T mValue;
+};
+#endif
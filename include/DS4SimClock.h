@@ -0,0 +1,32 @@
+#ifndef DS4_SIMCLOCK_H
+#define DS4_SIMCLOCK_H
+
+// Fixed-timestep clock for the particle simulation. advance() banks the time
+// since the last call and returns how many whole steps of getStepSeconds()
+// are due, carrying the remainder over, so the simulation runs at its own
+// rate whatever the frame rate is. getAlpha() is how far the carried time is
+// into the next step, for drawing positions between the last two steps.
+// A stall longer than the max steps (a breakpoint, a window drag) is dropped
+// rather than caught up.
+class DS4SimClock
+{
+public:
+	DS4SimClock();
+
+	void setRate(float pHz);
+	void setMaxSteps(int pMaxSteps) { mMaxSteps = pMaxSteps; }
+	void reset() { mAccumulator = 0; }
+
+	int advance(double pSeconds);
+
+	float getRate() const { return mRate; }
+	float getStepSeconds() const { return (float)mStepSeconds; }
+	float getAlpha() const { return (float)(mAccumulator / mStepSeconds); }
+
+private:
+	float mRate;
+	double mStepSeconds;
+	double mAccumulator;
+	int mMaxSteps;
+};
+#endif
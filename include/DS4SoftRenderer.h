@@ -0,0 +1,64 @@
+#ifndef DS4_SOFTRENDERER_H
+#define DS4_SOFTRENDERER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cinder/Matrix.h"
+#include "DS4PointBackend.h"
+#include "DS4WorkerPool.h"
+
+using namespace ci;
+using namespace std;
+
+// CPU stand-in for drawRunning()'s point passes on machines without a GPU.
+// Points are square, unsmoothed and additively blended (GL_SRC_ALPHA,
+// GL_ONE), sized and placed the way glPointSize points are, so the same
+// camera matrices give the same picture. drawPoints() projects in parallel
+// and queues splats, resolve() bins them into row bands in one pass and
+// rasterizes each band from its own list, one band per task, then writes the
+// 8-bit RGB image.
+class DS4SoftRenderer : public DS4PointBackend
+{
+public:
+	DS4SoftRenderer();
+
+	void setup(Vec2i pSize);
+	void setWorkerPool(DS4WorkerPoolRef pPool) { mWorkerPool = pPool; }
+
+	// Projection * view * model, as GL would see it
+	void setMatrix(const Matrix44f &pMatrix) { mMatrix = pMatrix; }
+
+	void clear();
+	void drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize) override;
+	void drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize) override;
+	const char* getName() const override { return "soft"; }
+	void resolve();
+
+	Vec2i getSize() const { return mSize; }
+	const uint8_t* getPixels() const { return mPixels.empty() ? nullptr : &mPixels[0]; }
+
+	// Any format cinder::writeImage knows from the extension
+	bool writeImage(const string &pPath);
+
+private:
+	struct Splat
+	{
+		int X0, Y0, X1, Y1;		//pixel rect, empty if culled
+		float R, G, B;			//color premultiplied by alpha
+	};
+
+	void queue(const Vec3f *pPoints, const ColorA *pColors, const ColorA &pColor, size_t pCount, float pPointSize);
+	void parallelFor(size_t pCount, size_t pChunkSize, const DS4RangeTask &pTask);
+
+	Vec2i mSize;
+	Matrix44f mMatrix;
+	DS4WorkerPoolRef mWorkerPool;
+	vector<Splat> mSplats;
+	vector<size_t> mBandStarts;		//band bi's splats are mBandSplats[mBandStarts[bi], mBandStarts[bi + 1])
+	vector<uint32_t> mBandSplats;	//splat indices, in draw order within each band
+	vector<size_t> mBandFill;
+	vector<float> mAccum;
+	vector<uint8_t> mPixels;
+};
+#endif
@@ -0,0 +1,66 @@
+#ifndef DS4_TRACE_H
+#define DS4_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Scoped hot-path timers and counters, exported as Chrome trace / Perfetto
+// JSON (load the file in chrome://tracing or ui.perfetto.dev).
+// Each thread records into its own fixed-size ring buffer with no locks or
+// allocation after its first event; the buffer keeps the most recent events,
+// so dump() shows the last few seconds before the dump was taken. A thread
+// only gets a ring once it records something, and hands it back with
+// releaseThread() before exiting so the next new thread can reuse it.
+struct DS4TraceEvent
+{
+	const char *Name;	//must be a string literal or otherwise outlive the trace
+	uint64_t Start;
+	uint64_t Duration;
+	int64_t Value;
+	uint32_t Type;
+};
+
+class DS4Trace
+{
+public:
+	enum EventType
+	{
+		EVENT_SCOPE = 0,
+		EVENT_COUNTER
+	};
+
+	static void setEnabled(bool pEnabled);
+	static bool isEnabled();
+
+	static uint64_t now();
+	static void scope(const char *pName, uint64_t pStart, uint64_t pEnd);
+	static void counter(const char *pName, int64_t pValue);
+	static void setThreadName(const char *pName);
+	// Call last thing on a thread that traced, its ring and events are
+	// dropped and the ring goes to the next thread that records
+	static void releaseThread();
+
+	static bool dump(const string &pPath);
+};
+
+class DS4TraceScope
+{
+public:
+	explicit DS4TraceScope(const char *pName) : mName(pName), mStart(DS4Trace::now()) {}
+	~DS4TraceScope() { DS4Trace::scope(mName, mStart, DS4Trace::now()); }
+
+private:
+	DS4TraceScope(const DS4TraceScope&);
+	DS4TraceScope& operator=(const DS4TraceScope&);
+
+	const char *mName;
+	uint64_t mStart;
+};
+
+#define DS4_TRACE_CONCAT_(a, b) a##b
+#define DS4_TRACE_CONCAT(a, b) DS4_TRACE_CONCAT_(a, b)
+#define DS4_TRACE_SCOPE(pName) DS4TraceScope DS4_TRACE_CONCAT(cTraceScope, __LINE__)(pName)
+#define DS4_TRACE_COUNTER(pName, pValue) DS4Trace::counter(pName, static_cast<int64_t>(pValue))
+#endif
@@ -0,0 +1,50 @@
+#ifndef DS4_TRIPLEBUFFER_H
+#define DS4_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// Single producer, single consumer triple buffer. The producer fills
+// getBack() and publish()es it, the consumer acquire()s the newest published
+// slot and reads getFront(). Neither side ever waits on the other: publishing
+// over a slot the consumer never took replaces it, acquiring with nothing
+// new keeps the current front.
+template<typename T>
+class DS4TripleBuffer
+{
+public:
+	DS4TripleBuffer() : mBack(0), mFront(2) { mMiddle = 1; }
+
+	T& getBack() { return mSlots[mBack]; }
+	T& getFront() { return mSlots[mFront]; }
+	const T& getFront() const { return mSlots[mFront]; }
+
+	// Producer side, returns false if an unconsumed frame was replaced
+	bool publish()
+	{
+		uint32_t cPrev = mMiddle.exchange(mBack | S_FRESH, memory_order_acq_rel);
+		mBack = cPrev & S_INDEX;
+		return (cPrev & S_FRESH) == 0;
+	}
+
+	// Consumer side, returns false if nothing was published since last time
+	bool acquire()
+	{
+		if ((mMiddle.load(memory_order_relaxed) & S_FRESH) == 0)
+			return false;
+		uint32_t cPrev = mMiddle.exchange(mFront, memory_order_acq_rel);
+		mFront = cPrev & S_INDEX;
+		return true;
+	}
+
+private:
+	static const uint32_t S_INDEX = 3;
+	static const uint32_t S_FRESH = 4;
+
+	T mSlots[3];
+	uint32_t mBack, mFront;
+	atomic<uint32_t> mMiddle;
+};
+#endif
@@ -0,0 +1,50 @@
+#ifndef DS4_VOXELGRID_H
+#define DS4_VOXELGRID_H
+
+#include <cstdint>
+#include <vector>
+#include "cinder/Vector.h"
+
+using namespace ci;
+using namespace std;
+
+// Spatial hash downsampler: every point added between begin() and
+// getPoints() is binned into a cube of setVoxelSize() and each occupied
+// voxel comes out as the average of its points, in the order the voxels
+// were first hit. The table is open addressed with linear probing and
+// tagged with a generation counter, so begin() empties it without touching
+// the slots and nothing is allocated per frame once the table is big enough.
+class DS4VoxelGrid
+{
+public:
+	DS4VoxelGrid();
+
+	void setVoxelSize(float pSize);
+	float getVoxelSize() const { return mVoxelSize; }
+
+	void begin();
+	void add(const Vec3f &pPoint);
+	// Appends the voxel averages to pPoints
+	void getPoints(vector<Vec3f> &pPoints) const;
+	size_t getVoxelCount() const { return mOccupied.size(); }
+
+private:
+	struct Slot
+	{
+		uint64_t Key;
+		uint32_t Generation;	//slot is empty unless this matches mGeneration
+		uint32_t Count;
+		float SumX, SumY, SumZ;
+	};
+
+	static uint64_t pack(int pX, int pY, int pZ);
+	uint32_t find(uint64_t pKey) const;
+	void grow();
+
+	float mVoxelSize, mInvVoxelSize;
+	uint32_t mGeneration;
+	uint32_t mShift;
+	vector<Slot> mSlots;
+	vector<uint32_t> mOccupied;
+};
+#endif
@@ -0,0 +1,63 @@
+#ifndef DS4_WORKERPOOL_H
+#define DS4_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef function<void(size_t pBegin, size_t pEnd)> DS4RangeTask;
+
+// Persistent worker threads for data-parallel loops. parallelFor() splits
+// [0, pCount) into fixed-size chunks that the workers and the calling thread
+// claim from a shared atomic counter, so faster threads pick up the chunks
+// slower ones never got to. It returns once every chunk has run. A call
+// made while another thread's parallelFor() holds the pool runs serially on
+// the calling thread instead of waiting.
+class DS4WorkerPool
+{
+public:
+	// pWorkers == 0 starts one worker per hardware thread, minus the caller
+	explicit DS4WorkerPool(size_t pWorkers = 0);
+	~DS4WorkerPool();
+
+	void parallelFor(size_t pCount, size_t pChunkSize, const DS4RangeTask &pTask);
+	// Wraps a lambda by reference: a DS4RangeTask built from a copy of one
+	// with a few captures heap-allocates on every call
+	template<typename T> void parallelFor(size_t pCount, size_t pChunkSize, const T &pTask)
+	{
+		parallelFor(pCount, pChunkSize, DS4RangeTask(cref(pTask)));
+	}
+	// Lets only the first pWorkers workers take part in later calls, the rest
+	// stay parked, so one pool can be measured at every size
+	void setActiveWorkers(size_t pWorkers);
+	inline size_t getWorkerCount() const { return mThreads.size(); }
+	inline size_t getThreadCount() const { return mActiveWorkers + 1; }
+
+private:
+	DS4WorkerPool(const DS4WorkerPool&);
+	DS4WorkerPool& operator=(const DS4WorkerPool&);
+
+	void workerLoop(size_t pIndex);
+	void runChunks();
+
+	vector<thread> mThreads;
+	mutex mCallMutex;
+	mutex mMutex;
+	condition_variable mWakeCond, mDoneCond;
+
+	const DS4RangeTask *mTask;
+	size_t mCount, mChunkSize, mChunkCount, mBusy, mActiveWorkers;
+	atomic<size_t> mNextChunk;
+	uint64_t mGeneration;
+	bool mQuit;
+};
+
+typedef shared_ptr<DS4WorkerPool> DS4WorkerPoolRef;
+#endif
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "DS4AudioAnalyzer.h"
+
+static const float S_PI = 3.14159265358979f;
+static const size_t S_FLUX_HISTORY = 32;
+
+DS4AudioAnalyzer::DS4AudioAnalyzer() : mSampleRate(0), mHistoryPos(0), mSinceAnalysis(0), mFluxPos(0), mLoudness(0), mOnsetCount(0), mBlockCount(0), mLastOnsetBlock(0)
+{
+
+}
+
+void DS4AudioAnalyzer::setup(float pSampleRate, const DS4AudioSettings &pSettings)
+{
+	mSampleRate = pSampleRate;
+	mSettings = pSettings;
+	if (mSettings.BandEdges.size() < 2)
+	{
+		float cEdges[] = { 0, 150, 400, 1000, 2500, 6000, 20000 };
+		mSettings.BandEdges.assign(cEdges, cEdges + sizeof(cEdges) / sizeof(cEdges[0]));
+	}
+	if (mSettings.BandEdges.size() > DS4_AUDIO_MAX_BANDS + 1)
+		mSettings.BandEdges.resize(DS4_AUDIO_MAX_BANDS + 1);
+
+	size_t cFftSize = 1;
+	while (cFftSize < mSettings.FftSize)
+		cFftSize <<= 1;
+	mSettings.FftSize = cFftSize;
+	mSettings.WindowSize = min(mSettings.WindowSize, cFftSize);
+	mSettings.HopSize = max<size_t>(1, mSettings.HopSize);
+
+	//Blackman, MonitorSpectralNode's default window
+	mWindow.resize(mSettings.WindowSize);
+	for (size_t wi = 0; wi < mWindow.size(); ++wi)
+	{
+		float cPhase = 2.0f * S_PI * wi / (mWindow.size() - 1);
+		mWindow[wi] = 0.42f - 0.5f * cos(cPhase) + 0.08f * cos(2.0f * cPhase);
+	}
+
+	mHistory.assign(mSettings.WindowSize, 0);
+	mHistoryPos = 0;
+	mSinceAnalysis = 0;
+	mReal.assign(cFftSize, 0);
+	mImag.assign(cFftSize, 0);
+	mCos.resize(cFftSize / 2);
+	mSin.resize(cFftSize / 2);
+	for (size_t ti = 0; ti < cFftSize / 2; ++ti)
+	{
+		mCos[ti] = cos(2.0f * S_PI * ti / cFftSize);
+		mSin[ti] = -sin(2.0f * S_PI * ti / cFftSize);
+	}
+	int cBits = 0;
+	while ((size_t(1) << cBits) < cFftSize)
+		++cBits;
+	mBitReverse.resize(cFftSize);
+	for (uint32_t bi = 0; bi < cFftSize; ++bi)
+	{
+		uint32_t cReversed = 0;
+		for (int ci = 0; ci < cBits; ++ci)
+			cReversed |= ((bi >> ci) & 1) << (cBits - 1 - ci);
+		mBitReverse[bi] = cReversed;
+	}
+
+	mMagnitudes.assign(cFftSize / 2, 0);
+	mPrevMagnitudes.assign(cFftSize / 2, 0);
+	mBandBins.resize(mSettings.BandEdges.size());
+	for (size_t ei = 0; ei < mBandBins.size(); ++ei)
+	{
+		int cBin = (int)(mSettings.BandEdges[ei] * cFftSize / mSampleRate + 0.5f);
+		mBandBins[ei] = min(max(cBin, 0), (int)mMagnitudes.size());
+	}
+
+	mFluxHistory.assign(S_FLUX_HISTORY, 0);
+	mFluxPos = 0;
+	mLoudness = 0;
+	mOnsetCount = 0;
+	mBlockCount = 0;
+	mLastOnsetBlock = 0;
+	mFeatures.store(DS4AudioFeatures());
+}
+
+void DS4AudioAnalyzer::process(const float *pSamples, size_t pCount)
+{
+	if (mHistory.empty())
+		return;
+
+	for (size_t si = 0; si < pCount; ++si)
+	{
+		mHistory[mHistoryPos] = pSamples[si];
+		mHistoryPos = (mHistoryPos + 1) % mHistory.size();
+		if (++mSinceAnalysis >= mSettings.HopSize)
+		{
+			mSinceAnalysis = 0;
+			analyze();
+		}
+	}
+}
+
+void DS4AudioAnalyzer::analyze()
+{
+	size_t cWindowSize = mHistory.size();
+	for (size_t wi = 0; wi < cWindowSize; ++wi)
+		mReal[wi] = mHistory[(mHistoryPos + wi) % cWindowSize] * mWindow[wi];
+	fill(mReal.begin() + cWindowSize, mReal.end(), 0.0f);
+	fill(mImag.begin(), mImag.end(), 0.0f);
+	fft();
+
+	//Normalized, smoothed magnitudes the way MonitorSpectralNode computes them
+	float cScale = 1.0f / mReal.size();
+	float cSmoothing = mSettings.Smoothing;
+	float cSum = 0, cFlux = 0;
+	mImag[0] = 0;
+	for (size_t bi = 0; bi < mMagnitudes.size(); ++bi)
+	{
+		float cMag = sqrt(mReal[bi] * mReal[bi] + mImag[bi] * mImag[bi]) * cScale;
+		float cSmoothed = mMagnitudes[bi] * cSmoothing + cMag * (1 - cSmoothing);
+		cFlux += max(0.0f, cSmoothed - mPrevMagnitudes[bi]);
+		mPrevMagnitudes[bi] = cSmoothed;
+		mMagnitudes[bi] = cSmoothed;
+		cSum += cSmoothed;
+	}
+
+	DS4AudioFeatures cFeatures;
+	cFeatures.Level = min(max(cSum / mMagnitudes.size() * 10000, 0.0f), 1.0f);
+	float cRate = cFeatures.Level > mLoudness ? mSettings.LoudnessAttack : mSettings.LoudnessRelease;
+	mLoudness += (cFeatures.Level - mLoudness) * cRate;
+	cFeatures.Loudness = mLoudness;
+
+	cFeatures.BandCount = (int)mBandBins.size() - 1;
+	for (int bi = 0; bi < DS4_AUDIO_MAX_BANDS; ++bi)
+	{
+		float cBand = 0;
+		if (bi < cFeatures.BandCount && mBandBins[bi + 1] > mBandBins[bi])
+		{
+			for (int ki = mBandBins[bi]; ki < mBandBins[bi + 1]; ++ki)
+				cBand += mMagnitudes[ki];
+			cBand = min(cBand / (mBandBins[bi + 1] - mBandBins[bi]) * 10000, 1.0f);
+		}
+		cFeatures.Bands[bi] = cBand;
+	}
+
+	//Onset: flux well above its recent average, at most one per OnsetInterval
+	float cMeanFlux = 0;
+	for (auto cF : mFluxHistory)
+		cMeanFlux += cF;
+	cMeanFlux /= mFluxHistory.size();
+	mFluxHistory[mFluxPos] = cFlux;
+	mFluxPos = (mFluxPos + 1) % mFluxHistory.size();
+
+	++mBlockCount;
+	uint64_t cMinBlocks = (uint64_t)(mSettings.OnsetInterval * mSampleRate / mSettings.HopSize);
+	if (cFlux > cMeanFlux * mSettings.OnsetThreshold && cFlux > 1e-6f && mBlockCount - mLastOnsetBlock > cMinBlocks)
+	{
+		++mOnsetCount;
+		mLastOnsetBlock = mBlockCount;
+	}
+	cFeatures.Flux = cFlux;
+	cFeatures.OnsetCount = mOnsetCount;
+	cFeatures.BlockCount = mBlockCount;
+	mFeatures.store(cFeatures);
+}
+
+// In-place iterative radix-2 over mReal/mImag
+void DS4AudioAnalyzer::fft()
+{
+	size_t cSize = mReal.size();
+	for (size_t bi = 0; bi < cSize; ++bi)
+	{
+		size_t cOther = mBitReverse[bi];
+		if (cOther > bi)
+		{
+			swap(mReal[bi], mReal[cOther]);
+			swap(mImag[bi], mImag[cOther]);
+		}
+	}
+
+	for (size_t cSpan = 2; cSpan <= cSize; cSpan <<= 1)
+	{
+		size_t cHalf = cSpan / 2;
+		size_t cStride = cSize / cSpan;
+		for (size_t si = 0; si < cSize; si += cSpan)
+		{
+			for (size_t ki = 0; ki < cHalf; ++ki)
+			{
+				float cWr = mCos[ki*cStride], cWi = mSin[ki*cStride];
+				size_t cA = si + ki, cB = cA + cHalf;
+				float cTr = mReal[cB] * cWr - mImag[cB] * cWi;
+				float cTi = mReal[cB] * cWi + mImag[cB] * cWr;
+				mReal[cB] = mReal[cA] - cTr;
+				mImag[cB] = mImag[cA] - cTi;
+				mReal[cA] += cTr;
+				mImag[cA] += cTi;
+			}
+		}
+	}
+}
+
+bool DS4LoadWav(const string &pPath, vector<float> &pSamples, float &pSampleRate)
+{
+	ifstream cFile(pPath.c_str(), ios::binary);
+	if (!cFile)
+		return false;
+
+	char cTag[4];
+	uint32_t cSize;
+	cFile.read(cTag, 4);
+	cFile.read((char*)&cSize, 4);
+	char cWave[4];
+	cFile.read(cWave, 4);
+	if (!cFile || string(cTag, 4) != "RIFF" || string(cWave, 4) != "WAVE")
+		return false;
+
+	uint16_t cFormat = 0, cChannels = 0, cBits = 0;
+	uint32_t cRate = 0;
+	bool cHasFmt = false;
+	while (cFile.read(cTag, 4) && cFile.read((char*)&cSize, 4))
+	{
+		string cChunk(cTag, 4);
+		if (cChunk == "fmt ")
+		{
+			if (cSize < 16)
+				return false;
+			vector<char> cFmt(cSize);
+			if (!cFile.read(&cFmt[0], cSize))
+				return false;
+			if (cSize & 1)
+				cFile.seekg(1, ios::cur);
+			memcpy(&cFormat, &cFmt[0], 2);
+			memcpy(&cChannels, &cFmt[2], 2);
+			memcpy(&cRate, &cFmt[4], 4);
+			memcpy(&cBits, &cFmt[14], 2);
+			if (cFormat == 0xFFFE && cSize >= 26)
+				memcpy(&cFormat, &cFmt[24], 2);	//WAVE_FORMAT_EXTENSIBLE subformat
+			cHasFmt = true;
+		}
+		else if (cChunk == "data")
+		{
+			bool cIsPcm16 = cFormat == 1 && cBits == 16;
+			bool cIsFloat = cFormat == 3 && cBits == 32;
+			//The format has to come first, and a zero rate would divide by
+			//zero in the analyzer's band bins
+			if (!cHasFmt || cRate == 0 || cChannels == 0 || (!cIsPcm16 && !cIsFloat))
+				return false;
+
+			size_t cFrames = cSize / (cChannels * (cBits / 8));
+			vector<char> cData(cFrames * cChannels * (cBits / 8));
+			cFile.read(cData.empty() ? nullptr : &cData[0], cData.size());
+			cFrames = (size_t)cFile.gcount() / (cChannels * (cBits / 8));
+
+			pSamples.assign(cFrames, 0);
+			for (size_t fi = 0; fi < cFrames; ++fi)
+			{
+				float cSum = 0;
+				for (int ci = 0; ci < cChannels; ++ci)
+				{
+					size_t cIndex = fi * cChannels + ci;
+					if (cIsPcm16)
+					{
+						int16_t cValue;
+						memcpy(&cValue, &cData[cIndex * 2], 2);
+						cSum += cValue / 32768.0f;
+					}
+					else
+					{
+						float cValue;
+						memcpy(&cValue, &cData[cIndex * 4], 4);
+						cSum += cValue;
+					}
+				}
+				pSamples[fi] = cSum / cChannels;
+			}
+			pSampleRate = (float)cRate;
+			return true;
+		}
+		else
+			cFile.seekg(cSize + (cSize & 1), ios::cur);
+	}
+	return false;
+}
@@ -0,0 +1,16 @@
+#include "DS4AudioAnalyzerNode.h"
+
+DS4AudioAnalyzerNode::DS4AudioAnalyzerNode(const DS4AudioSettings &pSettings, const Format &pFormat) : NodeAutoPullable(pFormat), mSettings(pSettings)
+{
+
+}
+
+void DS4AudioAnalyzerNode::initialize()
+{
+	mAnalyzer.setup((float)getSampleRate(), mSettings);
+}
+
+void DS4AudioAnalyzerNode::process(audio::Buffer *pBuffer)
+{
+	mAnalyzer.process(pBuffer->getChannel(0), pBuffer->getNumFrames());
+}
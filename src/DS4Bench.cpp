@@ -0,0 +1,564 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include "cinder/Camera.h"
+#include "cinder/Timer.h"
+#include "DS4AudioAnalyzer.h"
+#include "DS4DepthProcessor.h"
+#include "DS4Particle.h"
+#include "DS4PointBackend.h"
+#include "DS4ReplaySource.h"
+#include "DS4SimClock.h"
+#include "DS4SoftRenderer.h"
+#include "DS4Trace.h"
+
+using namespace ci;
+using namespace std;
+namespace bpo = boost::program_options;
+namespace bfs = boost::filesystem;
+
+// DS4Bench: runs the depth pipeline and particle step headless over recorded
+// (.ds4r or raw frame directory) or synthetic depth and reports per-stage
+// timings. No window, GL context or audio device is created.
+
+static Vec2i S_DEPTH_SIZE(480, 360);
+static Vec2i S_RENDER_SIZE(1280, 720);
+
+enum BenchStage
+{
+	STAGE_AUDIO = 0,
+	STAGE_DENOISE,
+	STAGE_QUANTIZE,
+	STAGE_CLOUD,
+	STAGE_CONTOURS,
+	STAGE_ANALYSIS,
+	STAGE_SPAWN,
+	STAGE_STEP,
+	STAGE_SUBMIT,
+	STAGE_RENDER,
+	STAGE_COUNT
+};
+
+static const char *S_STAGE_NAMES[STAGE_COUNT] = {
+	"audio analysis",
+	"temporal denoise",
+	"quantize+threshold",
+	"cloud deprojection",
+	"absdiff/findContours",
+	"contour analysis",
+	"spawning",
+	"particle step",
+	"point submit",
+	"soft render"
+};
+
+#pragma region Allocation Counting
+// Every operator new in the process bumps sAllocCount, so the timed part of a
+// frame can be checked for heap allocations. OpenCV allocates its own image
+// and sequence memory through cv::fastMalloc, which isn't counted.
+static atomic<size_t> sAllocCount(0);
+
+void* operator new(size_t pSize)
+{
+	++sAllocCount;
+	void *cPtr = malloc(pSize ? pSize : 1);
+	if (!cPtr)
+		throw bad_alloc();
+	return cPtr;
+}
+
+void* operator new[](size_t pSize)
+{
+	return operator new(pSize);
+}
+
+void operator delete(void *pPtr) throw()
+{
+	free(pPtr);
+}
+
+void operator delete[](void *pPtr) throw()
+{
+	free(pPtr);
+}
+#pragma endregion Allocation Counting
+
+#pragma region Synthetic
+// A performer-sized blob swaying and waving in front of an out-of-range wall,
+// standing on a floor that reaches the bottom rows, with a little sensor noise
+// and a sprinkle of dropouts.
+class DS4SyntheticDepth
+{
+public:
+	DS4SyntheticDepth(Vec2i pSize) : mSize(pSize), mSeed(12345), mFrame(pSize.x*pSize.y)
+	{
+		mIntrinsics.rfx = 425.0f;
+		mIntrinsics.rfy = 425.0f;
+		mIntrinsics.rpx = (pSize.x - 1) * 0.5f;
+		mIntrinsics.rpy = (pSize.y - 1) * 0.5f;
+		mIntrinsics.rw = pSize.x;
+		mIntrinsics.rh = pSize.y;
+	}
+
+	const DSCalibIntrinsicsRectified& getIntrinsics() const { return mIntrinsics; }
+
+	const uint16_t* generate(size_t pIndex)
+	{
+		float cT = pIndex / 60.0f;
+		float cBodyX = mSize.x*0.5f + sin(cT*0.7f)*mSize.x*0.2f;
+		float cBodyY = mSize.y*0.55f;
+		float cArm = sin(cT*3.0f);
+
+		for (int dy = 0; dy < mSize.y; ++dy)
+		{
+			for (int dx = 0; dx < mSize.x; ++dx)
+			{
+				float cDepth = 3500.0f;
+				if (dy > mSize.y * 0.85f)
+					cDepth = 1900.0f - (dy - mSize.y*0.85f) * 4.0f;
+
+				float cBx = (dx - cBodyX) / 45.0f;
+				float cBy = (dy - cBodyY) / 110.0f;
+				float cHx = (dx - cBodyX) / 22.0f;
+				float cHy = (dy - (cBodyY - 135.0f)) / 26.0f;
+				float cArmY = cBodyY - 60.0f + cArm*(dx - cBodyX)*0.6f;
+				bool cIsArm = fabs(dx - cBodyX) < 120.0f && fabs(dy - cArmY) < 10.0f;
+				if (cBx*cBx + cBy*cBy < 1.0f || cHx*cHx + cHy*cHy < 1.0f || cIsArm)
+					cDepth = 1400.0f + cBx * 30.0f;
+
+				mSeed = mSeed * 1664525u + 1013904223u;
+				int cNoise = static_cast<int>((mSeed >> 24) % 9) - 4;
+				bool cDropout = ((mSeed >> 8) & 0x3ff) == 0;
+				mFrame[dy*mSize.x + dx] = cDropout ? 0 : static_cast<uint16_t>(cDepth + cNoise);
+			}
+		}
+		return mFrame.data();
+	}
+
+private:
+	Vec2i mSize;
+	uint32_t mSeed;
+	vector<uint16_t> mFrame;
+	DSCalibIntrinsicsRectified mIntrinsics;
+};
+#pragma endregion Synthetic
+
+#pragma region Stats
+struct StageStats
+{
+	vector<double> Samples;
+
+	double mean() const
+	{
+		double cSum = 0;
+		for (double cV : Samples)
+			cSum += cV;
+		return Samples.empty() ? 0 : cSum / Samples.size();
+	}
+
+	double percentile(double pP) const
+	{
+		if (Samples.empty())
+			return 0;
+		vector<double> cSorted(Samples);
+		sort(cSorted.begin(), cSorted.end());
+		size_t cId = static_cast<size_t>(pP*(cSorted.size() - 1) + 0.5);
+		return cSorted[cId];
+	}
+};
+
+static void drawPointLayers(DS4PointBackend &pBackend, const DS4PointLayerParams &pLayers, const DS4DepthProcessor &pProcessor, DS4ParticleSystem &pParticles, float pLevel, float pSimAlpha)
+{
+	DS4DrawPointLayers(pBackend, pLayers, pProcessor.getCloudPoints(), pProcessor.getContourPoints(), pProcessor.getBorderPoints(), pParticles, pLevel, pSimAlpha);
+}
+
+static void printStats(const string &pName, const StageStats &pStats, double pPixels)
+{
+	double cMean = pStats.mean();
+	cout << "  " << left << setw(22) << pName << right << fixed << setprecision(3)
+		<< setw(9) << cMean << " ms mean"
+		<< setw(9) << pStats.percentile(0.5) << " p50"
+		<< setw(9) << pStats.percentile(0.99) << " p99";
+	if (pPixels > 0 && cMean > 0)
+		cout << setw(10) << setprecision(1) << pPixels / (cMean*1000.0) << " Mpix/s";
+	cout << endl;
+}
+#pragma endregion Stats
+
+// Layer keys a config leaves out fall back to what the app's readConfig()
+// uses, not to its no-config defaults
+static bool readParams(const string &pPath, DS4CVParams &pParams, DS4PointLayerParams &pLayers, int &pParticles, float &pSimRate)
+{
+	ifstream cFile(pPath.c_str());
+	if (!cFile)
+		return false;
+
+	int cAgeMin = 0, cAgeMax = 0, cColorMode = 0;
+	bpo::options_description cDesc("Configuration");
+	bpo::variables_map cVars;
+	cDesc.add_options()
+		("min_depth", bpo::value<int>(&pParams.DepthMin))
+		("max_depth", bpo::value<int>(&pParams.DepthMax))
+		("threshold", bpo::value<double>(&pParams.Thresh))
+		("min_poly_area", bpo::value<double>(&pParams.SizeMin))
+		("denoise", bpo::value<bool>(&pParams.Denoise))
+		("denoise_alpha", bpo::value<float>(&pParams.DenoiseAlpha))
+		("denoise_snap", bpo::value<int>(&pParams.DenoiseSnap))
+		("denoise_hole_frames", bpo::value<int>(&pParams.DenoiseHoleFrames))
+		("cloud_mode", bpo::value<int>(&pParams.CloudMode))
+		("voxel_size", bpo::value<float>(&pParams.VoxelSize))
+		("cloud_res", bpo::value<int>(&pParams.CloudRes))
+		("spawner_res", bpo::value<int>(&pParams.SpawnRes))
+		("spawn_rate", bpo::value<int>(&pParams.FramesSpawn))
+		("min_life", bpo::value<float>(&pParams.LifeMin))
+		("max_life", bpo::value<float>(&pParams.LifeMax))
+		("min_age", bpo::value<int>(&cAgeMin))
+		("max_age", bpo::value<int>(&cAgeMax))
+		("sim_rate", bpo::value<float>(&pSimRate))
+		("particle_alpha", bpo::value<float>(&pParams.ParticleAlpha))
+		("spawn_level", bpo::value<float>(&pParams.SpawnLevel))
+		("particle_count", bpo::value<int>(&pParticles))
+		("point_size", bpo::value<float>(&pLayers.PointSize)->default_value(2.0f))
+		("particle_size", bpo::value<float>(&pLayers.ParticleSize)->default_value(2.0f))
+		("bolt_min", bpo::value<float>(&pLayers.BoltWidthMin)->default_value(0.5f))
+		("bolt_max", bpo::value<float>(&pLayers.BoltWidthMax)->default_value(4.0f))
+		("bolt_a_min", bpo::value<float>(&pLayers.BoltAlphaMin)->default_value(0.01f))
+		("bolt_a_max", bpo::value<float>(&pLayers.BoltAlphaMax)->default_value(0.25f))
+		("color_mode", bpo::value<int>(&cColorMode)->default_value(0))
+	;
+
+	try
+	{
+		bpo::store(bpo::parse_config_file(cFile, cDesc, true), cVars);
+		bpo::notify(cVars);
+	}
+	catch (bpo::error &e)
+	{
+		cerr << "Error parsing config file: " << e.what() << endl;
+		return false;
+	}
+
+	//Older configs give lifetimes in 60 fps frames
+	if (!cVars.count("min_life") && cVars.count("min_age"))
+		pParams.LifeMin = cAgeMin / 60.0f;
+	if (!cVars.count("max_life") && cVars.count("max_age"))
+		pParams.LifeMax = cAgeMax / 60.0f;
+	pLayers.ColorMode = static_cast<DS4PColorMode>(cColorMode);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	string cInput, cConfig, cWriteSynthetic, cTrace, cAudio, cRender;
+	int cFrames, cWarmup, cParticles, cThreads;
+	uint32_t cSeed;
+	float cLevel, cSimRate;
+
+	bpo::options_description cDesc("DS4Bench options");
+	cDesc.add_options()
+		("help", "Show this help")
+		("input", bpo::value<string>(&cInput), ".ds4r recording or raw frame directory, synthetic depth if omitted")
+		("config", bpo::value<string>(&cConfig), "particle_config.cfg to take CV and particle settings from")
+		("frames", bpo::value<int>(&cFrames)->default_value(600), "Frames to measure (recordings loop if shorter)")
+		("warmup", bpo::value<int>(&cWarmup)->default_value(30), "Frames to run before measuring")
+		("particles", bpo::value<int>(&cParticles)->default_value(5000), "Particle pool size")
+		("threads", bpo::value<int>(&cThreads)->default_value(0), "Threads for the cloud and particle step, 0 uses every core, 1 runs serially")
+		("seed", bpo::value<uint32_t>(&cSeed)->default_value(1), "Particle random seed")
+		("sim-rate", bpo::value<float>(&cSimRate)->default_value(60.0f), "Particle simulation steps per second, frames are fed at 60 fps")
+		("level", bpo::value<float>(&cLevel)->default_value(1.0f), "Audio level fed to the spawner")
+		("audio", bpo::value<string>(&cAudio), "WAV file to analyze at 60 fps in place of --level")
+		("write-synthetic", bpo::value<string>(&cWriteSynthetic), "Write the synthetic frames as a replay directory and exit")
+		("trace", bpo::value<string>(&cTrace), "Write a Chrome trace of the last measured frames")
+		("render", bpo::value<string>(&cRender), "Soft render the measured frames to PNGs in this directory")
+	;
+
+	bpo::variables_map cVars;
+	try
+	{
+		bpo::store(bpo::parse_command_line(argc, argv, cDesc), cVars);
+		bpo::notify(cVars);
+	}
+	catch (bpo::error &e)
+	{
+		cerr << e.what() << endl << cDesc << endl;
+		return 1;
+	}
+	if (cVars.count("help"))
+	{
+		cout << cDesc << endl;
+		return 0;
+	}
+
+	//Same defaults as the app uses without a config file
+	DS4CVParams cParams;
+	cParams.DepthMin = 0;
+	cParams.DepthMax = 2000;
+	cParams.Thresh = 128;
+	cParams.SizeMin = 250;
+	cParams.Denoise = false;
+	cParams.DenoiseAlpha = 0.5f;
+	cParams.DenoiseSnap = 50;
+	cParams.DenoiseHoleFrames = 3;
+	cParams.CloudMode = CLOUD_MODE_STRIDE;
+	cParams.VoxelSize = 15.0f;
+	cParams.CloudRes = 2;
+	cParams.BoltRes = 1;	//every contour point, as the app draws without the governor
+	cParams.SpawnRes = 4;
+	cParams.FramesSpawn = 5;
+	cParams.LifeMin = 0.5f;
+	cParams.LifeMax = 2.0f;
+	cParams.ParticleAlpha = 0.15f;
+	cParams.SpawnLevel = 0.15f;
+	cParams.IsDebug = false;
+	DS4PointLayerParams cLayers;
+	cLayers.PointSize = 2.0f;
+	cLayers.ParticleSize = 2.0f;
+	cLayers.BoltWidthMin = 0.1f;
+	cLayers.BoltWidthMax = 8.0f;
+	cLayers.BoltAlphaMin = 0.0f;
+	cLayers.BoltAlphaMax = 1.0f;
+	cLayers.ColorMode = COLOR_MODE_BLUE;
+	if (!cConfig.empty() && !readParams(cConfig, cParams, cLayers, cParticles, cSimRate))
+		return 1;
+	cFrames = max(cFrames, 1);
+	cWarmup = max(cWarmup, 0);
+	cParams.Level = cLevel;
+
+	DS4SyntheticDepth cSynthetic(S_DEPTH_SIZE);
+	if (!cWriteSynthetic.empty())
+	{
+		DS4ReplaySource::writeIntrinsics(cWriteSynthetic, cSynthetic.getIntrinsics(), 60);
+		for (int fi = 0; fi < cFrames; ++fi)
+			DS4ReplaySource::writeFrame(cWriteSynthetic, fi, cSynthetic.generate(fi), S_DEPTH_SIZE);
+		cout << "Wrote " << cFrames << " synthetic frames to " << cWriteSynthetic << endl;
+		return 0;
+	}
+
+	shared_ptr<DS4ReplaySource> cReplay;
+	DSCalibIntrinsicsRectified cIntrinsics = cSynthetic.getIntrinsics();
+	if (!cInput.empty())
+	{
+		cReplay = make_shared<DS4ReplaySource>(cInput, DS4ReplaySource::SPEED_MAX, true);
+		if (!cReplay->startCapture() || !cReplay->getCalibIntrinsicsZ(cIntrinsics))
+		{
+			cerr << "Unable to open " << cInput << endl;
+			return 1;
+		}
+		if (cReplay->getZSize() != S_DEPTH_SIZE)
+		{
+			cerr << cInput << " is " << cReplay->getZSize().x << "x" << cReplay->getZSize().y << ", expected " << S_DEPTH_SIZE.x << "x" << S_DEPTH_SIZE.y << endl;
+			return 1;
+		}
+	}
+
+	vector<float> cAudioSamples;
+	DS4AudioAnalyzer cAnalyzer;
+	if (!cAudio.empty())
+	{
+		float cRate;
+		if (!DS4LoadWav(cAudio, cAudioSamples, cRate) || cAudioSamples.empty())
+		{
+			cerr << "Unable to read " << cAudio << endl;
+			return 1;
+		}
+		cAnalyzer.setup(cRate, DS4AudioSettings());
+	}
+
+	DS4DepthProcessor cProcessor;
+	cProcessor.setup(S_DEPTH_SIZE, cIntrinsics);
+	DS4WorkerPoolRef cPool;
+	if (cThreads != 1)
+		cPool = DS4WorkerPoolRef(new DS4WorkerPool(cThreads > 1 ? cThreads - 1 : 0));
+	cProcessor.setWorkerPool(cPool);
+
+	//Runs the same frames unfiltered, untimed, to count what denoising removes
+	DS4DepthProcessor cUnfiltered;
+	DS4CVParams cUnfilteredParams;
+	if (cParams.Denoise)
+	{
+		cUnfiltered.setup(S_DEPTH_SIZE, cIntrinsics);
+		cUnfiltered.setWorkerPool(cPool);
+	}
+	DS4ParticleSystem cParticleSystem;
+	cParticleSystem.setWorkerPool(cPool);
+	cParticleSystem.setCapacity(cParticles);
+	cParticleSystem.setSeed(cSeed);
+	DS4SimClock cSimClock;
+	cSimClock.setRate(cSimRate);
+
+	//The app's default camera, blue color mode and point sizes, no arcball rotation
+	DS4SoftRenderer cRenderer;
+	if (!cRender.empty())
+	{
+		CameraPersp cCamera;
+		cCamera.setPerspective(45.0f, S_RENDER_SIZE.x / (float)S_RENDER_SIZE.y, 100, 4000);
+		cCamera.setFovHorizontal(35.0f);
+		cCamera.setEyePoint(Vec3f(0, 606.351f, -757.588f));
+		cCamera.setViewDirection(Vec3f(0, -0.366f, 0.930f));
+		cCamera.setWorldUp(Vec3f(0, 1, 0));
+
+		bfs::create_directories(cRender);
+		cRenderer.setup(S_RENDER_SIZE);
+		cRenderer.setWorkerPool(cPool);
+		cRenderer.setMatrix(cCamera.getProjectionMatrix() * cCamera.getModelViewMatrix() * Matrix44f::createScale(Vec3f(-1, 1, 1)));
+	}
+
+	StageStats cStages[STAGE_COUNT], cTotal;
+	size_t cCloud = 0, cContours = 0, cSpawns = 0, cLive = 0;
+	size_t cUnfilteredContours = 0, cUnfilteredSpawns = 0;
+	size_t cDraws = 0, cVertices = 0, cBytes = 0;
+	size_t cAllocs = 0, cAllocsMax = 0, cAllocFrames = 0;
+	DS4CountingPointBackend cSubmit;
+	size_t cAudioFed = 0;
+	Timer cTimer;
+	for (int fi = 0; fi < cWarmup + cFrames; ++fi)
+	{
+		const uint16_t *cDepth;
+		if (cReplay)
+		{
+			if (!cReplay->grab())
+			{
+				cerr << "Unable to read frame " << fi << endl;
+				return 1;
+			}
+			cDepth = cReplay->getZImage();
+		}
+		else
+			cDepth = cSynthetic.generate(fi);
+
+		double cMs[STAGE_COUNT];
+		cTimer.start();
+		if (!cAudioSamples.empty())
+		{
+			//One 60 fps frame worth of samples, looping over the file
+			size_t cTarget = (size_t)((fi + 1) * (double)cAnalyzer.getSampleRate() / 60.0);
+			while (cAudioFed < cTarget)
+			{
+				size_t cPos = cAudioFed % cAudioSamples.size();
+				size_t cCount = min(cTarget - cAudioFed, cAudioSamples.size() - cPos);
+				cAnalyzer.process(&cAudioSamples[cPos], cCount);
+				cAudioFed += cCount;
+			}
+			cParams.Level = cAnalyzer.getFeatures().Level;
+		}
+		cMs[STAGE_AUDIO] = cTimer.getSeconds();
+		size_t cAllocsBefore = sAllocCount;
+		const uint16_t *cFiltered = cProcessor.denoise(cDepth, cParams);
+		cMs[STAGE_DENOISE] = cTimer.getSeconds();
+		cProcessor.quantize(cFiltered, cParams);
+		cMs[STAGE_QUANTIZE] = cTimer.getSeconds();
+		cProcessor.buildCloud(cParams);
+		cMs[STAGE_CLOUD] = cTimer.getSeconds();
+		cProcessor.findContours();
+		cMs[STAGE_CONTOURS] = cTimer.getSeconds();
+		cProcessor.analyzeContours(cParams);
+		cMs[STAGE_ANALYSIS] = cTimer.getSeconds();
+		cProcessor.collectSpawns(cParams, fi);
+		cProcessor.emit(cParticleSystem, cParams, fi);
+		cMs[STAGE_SPAWN] = cTimer.getSeconds();
+		int cSteps = cSimClock.advance(1.0 / 60.0);
+		for (int si = 0; si < cSteps; ++si)
+			cParticleSystem.step(cSimClock.getStepSeconds());
+		cMs[STAGE_STEP] = cTimer.getSeconds();
+		cSubmit.beginFrame();
+		drawPointLayers(cSubmit, cLayers, cProcessor, cParticleSystem, cParams.Level, cSimClock.getAlpha());
+		cMs[STAGE_SUBMIT] = cTimer.getSeconds();
+		size_t cFrameAllocs = sAllocCount - cAllocsBefore;
+		if (!cRender.empty())
+		{
+			cRenderer.clear();
+			drawPointLayers(cRenderer, cLayers, cProcessor, cParticleSystem, cParams.Level, cSimClock.getAlpha());
+			cRenderer.resolve();
+		}
+		cMs[STAGE_RENDER] = cTimer.getSeconds();
+		cTimer.stop();
+
+		if (cParams.Denoise)
+		{
+			cUnfilteredParams = cParams;
+			cUnfilteredParams.Denoise = false;
+			cUnfiltered.process(cDepth, cUnfilteredParams, fi);
+		}
+
+		//Writing the PNG is left out of the timings
+		if (!cRender.empty() && fi >= cWarmup)
+		{
+			ostringstream cName;
+			cName << "frame_" << setw(6) << setfill('0') << fi - cWarmup << ".png";
+			if (!cRenderer.writeImage((bfs::path(cRender) / cName.str()).string()))
+			{
+				cerr << "Unable to write " << cName.str() << " to " << cRender << endl;
+				return 1;
+			}
+		}
+
+		if (fi < cWarmup)
+			continue;
+
+		double cPrev = 0;
+		for (int si = 0; si < STAGE_COUNT; ++si)
+		{
+			cStages[si].Samples.push_back((cMs[si] - cPrev)*1000.0);
+			cPrev = cMs[si];
+		}
+		cTotal.Samples.push_back(cPrev*1000.0);
+		cAllocs += cFrameAllocs;
+		cAllocsMax = max(cAllocsMax, cFrameAllocs);
+		cAllocFrames += cFrameAllocs > 0 ? 1 : 0;
+
+		cCloud += cProcessor.getCloudPoints().size();
+		cContours += cProcessor.getContours().size();
+		cSpawns += cProcessor.getSpawnPoints().size() + cProcessor.getLongSpawnPoints().size();
+		cLive += cParticleSystem.count();
+		cDraws += cSubmit.getStats().Draws;
+		cVertices += cSubmit.getStats().Vertices;
+		cBytes += cSubmit.getStats().Bytes;
+		cUnfilteredContours += cUnfiltered.getContours().size();
+		cUnfilteredSpawns += cUnfiltered.getSpawnPoints().size() + cUnfiltered.getLongSpawnPoints().size();
+	}
+
+	double cPixels = S_DEPTH_SIZE.x*S_DEPTH_SIZE.y;
+	cout << "DS4Bench: " << (cReplay ? cReplay->getName() : string("synthetic depth")) << ", "
+		<< cFrames << " frames, " << S_DEPTH_SIZE.x << "x" << S_DEPTH_SIZE.y << ", "
+		<< DS4GetKernelName(cParticleSystem.getKernelLevel()) << " particle kernel at " << cSimClock.getRate() << " Hz, "
+		<< (cPool ? cPool->getThreadCount() : 1) << " threads" << endl;
+	for (int si = 0; si < STAGE_COUNT; ++si)
+		printStats(S_STAGE_NAMES[si], cStages[si], si >= STAGE_DENOISE && si <= STAGE_CONTOURS ? cPixels : 0);
+	printStats("frame", cTotal, cPixels);
+
+	double cMean = cTotal.mean();
+	cout << fixed << setprecision(1)
+		<< "  " << (cMean > 0 ? 1000.0 / cMean : 0) << " frames/sec, per frame avg: "
+		<< cCloud / cFrames << " cloud points, "
+		<< cContours / cFrames << " contours, "
+		<< cSpawns / cFrames << " spawn points, "
+		<< cLive / cFrames << " live particles" << endl;
+	cout << "  points: " << cVertices / cFrames << " vertices in " << cDraws / cFrames << " draws, "
+		<< cBytes / 1024.0 / cFrames << " KB streamed per frame" << endl;
+	cout << "  heap: " << (double)cAllocs / cFrames << " allocations per frame from denoise to submit, "
+		<< cAllocsMax << " max, " << cAllocFrames << " of " << cFrames << " frames allocated" << endl;
+	if (cParams.Denoise)
+		cout << "  denoise: removes " << ((double)cUnfilteredContours - cContours) / cFrames << " of " << (double)cUnfilteredContours / cFrames << " contours and "
+			<< ((double)cUnfilteredSpawns - cSpawns) / cFrames << " of " << (double)cUnfilteredSpawns / cFrames << " spawn points per frame" << endl;
+	if (!cAudioSamples.empty())
+		cout << "  audio: " << cAnalyzer.getFeatures().OnsetCount << " onsets in " << cAudioFed / cAnalyzer.getSampleRate() << " s" << endl;
+
+	if (!cTrace.empty())
+	{
+		if (DS4Trace::dump(cTrace))
+			cout << "  trace written to " << cTrace << endl;
+		else
+			cerr << "Unable to write trace to " << cTrace << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include <cstring>
+#include "DS4CVPipeline.h"
+#include "DS4Trace.h"
+
+DS4CVPipeline::DS4CVPipeline() : mProcessor(nullptr), mFrameNumber(0), mHasJob(false), mQuit(false)
+{
+
+}
+
+DS4CVPipeline::~DS4CVPipeline()
+{
+	stop();
+}
+
+void DS4CVPipeline::start(DS4DepthProcessor *pProcessor)
+{
+	stop();
+	Vec2i cSize = pProcessor->getSize();
+	mDepth.assign(cSize.x*cSize.y, 0);
+	mProcessor = pProcessor;
+	mHasJob = false;
+	mQuit = false;
+	mResult.reset();
+	mThread = thread(&DS4CVPipeline::processLoop, this);
+}
+
+void DS4CVPipeline::stop()
+{
+	if (!mThread.joinable())
+		return;
+	{
+		lock_guard<mutex> cLock(mMutex);
+		mQuit = true;
+	}
+	mJobCond.notify_one();
+	mThread.join();
+	mProcessor = nullptr;
+}
+
+DS4FrameResultRef DS4CVPipeline::submit(const uint16_t *pDepth, const DS4CVParams &pParams, uint64_t pFrameNumber)
+{
+	unique_lock<mutex> cLock(mMutex);
+	waitIdle(cLock);
+	DS4FrameResultRef cPrevious = mResult;
+
+	memcpy(&mDepth[0], pDepth, mDepth.size()*sizeof(uint16_t));
+	mParams = pParams;
+	mFrameNumber = pFrameNumber;
+	mHasJob = true;
+	cLock.unlock();
+	mJobCond.notify_one();
+	return cPrevious;
+}
+
+void DS4CVPipeline::waitIdle(unique_lock<mutex> &pLock)
+{
+	DS4_TRACE_SCOPE("pipeline.wait");
+	mDoneCond.wait(pLock, [this]{ return !mHasJob; });
+}
+
+void DS4CVPipeline::processLoop()
+{
+	DS4Trace::setThreadName("DS4 CV");
+	for (;;)
+	{
+		{
+			unique_lock<mutex> cLock(mMutex);
+			mJobCond.wait(cLock, [this]{ return mQuit || mHasJob; });
+			if (mQuit)
+			{
+				DS4Trace::releaseThread();
+				return;
+			}
+		}
+
+		//submit() does not touch the job fields until mHasJob drops
+		mProcessor->process(&mDepth[0], mParams, mFrameNumber);
+		DS4FrameResultRef cResult = mProcessor->takeResult(mParams, mFrameNumber);
+
+		{
+			lock_guard<mutex> cLock(mMutex);
+			mResult = cResult;
+			mHasJob = false;
+		}
+		mDoneCond.notify_one();
+	}
+}
@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstring>
+#include "DS4CaptureThread.h"
+#include "DS4Trace.h"
+
+DS4CaptureThread::DS4CaptureThread(DS4DepthSourceRef pSource) : mSource(pSource), mSize(0, 0), mZEnabled(false), mHasIntrinsics(false), mFramesRepeated(0)
+{
+	mQuit = false;
+	mFramesCaptured = 0;
+	mFramesDropped = 0;
+}
+
+DS4CaptureThread::~DS4CaptureThread()
+{
+	stopCapture();
+}
+
+bool DS4CaptureThread::startCapture()
+{
+	if (!mSource->startCapture())
+		return false;
+
+	//The wrapped source belongs to the capture thread from here on, so ask it
+	//for everything the app needs up front
+	mSize = mSource->getZSize();
+	mZEnabled = mSource->isZEnabled();
+	mHasIntrinsics = mSource->getCalibIntrinsicsZ(mIntrinsics);
+
+	mQuit = false;
+	mThread = thread(&DS4CaptureThread::captureLoop, this);
+	return true;
+}
+
+void DS4CaptureThread::stopCapture()
+{
+	if (!mThread.joinable())
+		return;
+	mQuit = true;
+	mThread.join();
+	mSource->stopCapture();
+}
+
+bool DS4CaptureThread::getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics)
+{
+	if (mHasIntrinsics)
+		pIntrinsics = mIntrinsics;
+	return mHasIntrinsics;
+}
+
+bool DS4CaptureThread::grab()
+{
+	if (mFrames.acquire())
+		return true;
+	++mFramesRepeated;
+	return false;
+}
+
+uint16_t* DS4CaptureThread::getZImage()
+{
+	vector<uint16_t> &cPixels = mFrames.getFront().Pixels;
+	return cPixels.empty() ? nullptr : &cPixels[0];
+}
+
+void DS4CaptureThread::captureLoop()
+{
+	DS4Trace::setThreadName("DS4 capture");
+	size_t cPixelCount = mSize.x*mSize.y;
+	while (!mQuit)
+	{
+		bool cGrabbed;
+		{
+			DS4_TRACE_SCOPE("capture.grab");
+			cGrabbed = mSource->grab();
+		}
+		if (!cGrabbed)
+		{
+			//DSAPI blocks in grab(), replay sources return early until the
+			//next frame is due
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+
+		DS4DepthFrame &cFrame = mFrames.getBack();
+		cFrame.Pixels.resize(cPixelCount);
+		memcpy(&cFrame.Pixels[0], mSource->getZImage(), cPixelCount*sizeof(uint16_t));
+		cFrame.Time = mSource->getFrameTime();
+		cFrame.FrameNumber = mSource->getFrameNumber();
+
+		++mFramesCaptured;
+		if (!mFrames.publish())
+			++mFramesDropped;
+		DS4_TRACE_COUNTER("capture dropped", mFramesDropped);
+	}
+	DS4Trace::releaseThread();
+}
@@ -0,0 +1,91 @@
+#ifdef _DEBUG
+#pragma comment(lib, "DSAPI32.dbg.lib")
+#else
+#pragma comment(lib, "DSAPI32.lib")
+#endif
+#include "cinder/app/App.h"
+#include "DS4DSAPISource.h"
+
+using namespace ci::app;
+
+DS4DSAPISource::DS4DSAPISource(Vec2i pSize, int pFPS) : mSize(pSize), mFPS(pFPS), mFrameTime(0), mFrameNumber(0)
+{
+	mDSAPI = DSAPIRef(DSCreate(DS_DS4_PLATFORM), DSDestroy);
+}
+
+bool DS4DSAPISource::startCapture()
+{
+	bool retVal = true;
+	if (!mDSAPI->probeConfiguration())
+	{
+		retVal = false;
+		console() << "Unable to get DS hardware config" << endl;
+	}
+	if (!mDSAPI->isCalibrationValid())
+	{
+		retVal = false;
+		console() << "Calibration is invalid" << endl;
+	}
+	if (!mDSAPI->enableLeft(true))
+	{
+		retVal = false;
+		console() << "Unable to start left stream" << endl;
+	}
+	if (!mDSAPI->enableRight(true))
+	{
+		retVal = false;
+		console() << "Unable to start right stream" << endl;
+	}
+	if (!mDSAPI->enableZ(true))
+	{
+		retVal = false;
+		console() << "Unable to start depth stream" << endl;
+	}
+	if (!mDSAPI->setLRZResolutionMode(true, mSize.x, mSize.y, mFPS, DS_LUMINANCE8))
+	{
+		retVal = false;
+		console() << "Unable to set requested depth resolution" << endl;
+	}
+	if (!mDSAPI->startCapture())
+	{
+		retVal = false;
+		console() << "Unable to start ds4" << endl;
+	}
+
+	return retVal;
+}
+
+void DS4DSAPISource::stopCapture()
+{
+	mDSAPI->stopCapture();
+}
+
+bool DS4DSAPISource::isZEnabled()
+{
+	return mDSAPI->isZEnabled();
+}
+
+bool DS4DSAPISource::grab()
+{
+	if (!mDSAPI->grab())
+		return false;
+
+	mFrameTime = mDSAPI->getFrameTime() / 1000.0;
+	mFrameNumber = mDSAPI->getFrameNumber();
+	return true;
+}
+
+uint16_t* DS4DSAPISource::getZImage()
+{
+	return mDSAPI->getZImage();
+}
+
+bool DS4DSAPISource::getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics)
+{
+	if (!mDSAPI->getCalibIntrinsicsZ(pIntrinsics))
+	{
+		console() << "Unable to set get depth intrinsics" << endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstring>
+#include "cinder/CinderMath.h"
+#include "DS4DepthFilter.h"
+#include "DS4Trace.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define DS4_FILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#pragma region Scalar
+// pKeep is (1 - alpha) in Q15: out = new + (old - new) * keep, rounded to
+// nearest so a still pixel settles exactly on the reading
+static void filterScalar(const uint16_t *pDepth, uint16_t *pState, uint16_t *pHoleAges, size_t pBegin, size_t pEnd, int pKeep, int pSnap, int pHoleFrames)
+{
+	for (size_t di = pBegin; di < pEnd; ++di)
+	{
+		int cNew = pDepth[di], cOld = pState[di], cHole = pHoleAges[di];
+		if (cNew == 0)
+		{
+			pState[di] = (uint16_t)(cOld != 0 && cHole < pHoleFrames ? cOld : 0);
+			pHoleAges[di] = (uint16_t)math<int>::min(cHole + 1, 0xffff);
+		}
+		else
+		{
+			int cDelta = cOld - cNew;
+			if (cOld != 0 && cDelta <= pSnap && cDelta >= -pSnap)
+				pState[di] = (uint16_t)(cNew + ((cDelta * 2 * pKeep + 0x8000) >> 16));
+			else
+				pState[di] = (uint16_t)cNew;
+			pHoleAges[di] = 0;
+		}
+	}
+}
+#pragma endregion Scalar
+
+#ifdef DS4_FILTER_SSE2
+#pragma region SSE2
+static size_t filterSSE2(const uint16_t *pDepth, uint16_t *pState, uint16_t *pHoleAges, size_t pCount, int pKeep, int pSnap, int pHoleFrames)
+{
+	const __m128i cZero = _mm_setzero_si128();
+	const __m128i cOne = _mm_set1_epi16(1);
+	const __m128i cKeep = _mm_set1_epi16((short)pKeep);
+	const __m128i cSnap = _mm_set1_epi16((short)pSnap);
+	const __m128i cHoleFrames = _mm_set1_epi16((short)pHoleFrames);
+
+	size_t di = 0;
+	for (; di + 8 <= pCount; di += 8)
+	{
+		__m128i cNew = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepth + di));
+		__m128i cOld = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pState + di));
+		__m128i cHole = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pHoleAges + di));
+		__m128i cNewZero = _mm_cmpeq_epi16(cNew, cZero);
+		__m128i cOldZero = _mm_cmpeq_epi16(cOld, cZero);
+
+		//Valid reading: smooth where |old - new| <= snap and old is valid
+		__m128i cAbs = _mm_or_si128(_mm_subs_epu16(cNew, cOld), _mm_subs_epu16(cOld, cNew));
+		__m128i cNear = _mm_cmpeq_epi16(_mm_subs_epu16(cAbs, cSnap), cZero);
+		//High half of the Q15 product plus the rounding bit from the low half
+		__m128i cDelta2 = _mm_slli_epi16(_mm_sub_epi16(cOld, cNew), 1);
+		__m128i cRound = _mm_srli_epi16(_mm_mullo_epi16(cDelta2, cKeep), 15);
+		__m128i cSmooth = _mm_add_epi16(cNew, _mm_add_epi16(_mm_mulhi_epi16(cDelta2, cKeep), cRound));
+		__m128i cUseSmooth = _mm_andnot_si128(cOldZero, cNear);
+		__m128i cValid = _mm_or_si128(_mm_and_si128(cUseSmooth, cSmooth), _mm_andnot_si128(cUseSmooth, cNew));
+
+		//Dropout: hold old while hole age < hole frames (unsigned compare)
+		__m128i cExpired = _mm_cmpeq_epi16(_mm_subs_epu16(cHoleFrames, cHole), cZero);
+		__m128i cHeld = _mm_andnot_si128(_mm_or_si128(cOldZero, cExpired), cOld);
+
+		__m128i cOut = _mm_or_si128(_mm_and_si128(cNewZero, cHeld), _mm_andnot_si128(cNewZero, cValid));
+		__m128i cAges = _mm_and_si128(cNewZero, _mm_adds_epu16(cHole, cOne));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pState + di), cOut);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pHoleAges + di), cAges);
+	}
+	return di;
+}
+#pragma endregion SSE2
+#endif
+
+DS4DepthFilter::DS4DepthFilter() : mSize(0, 0), mIsPrimed(false)
+{
+
+}
+
+void DS4DepthFilter::setup(Vec2i pSize)
+{
+	mSize = pSize;
+	mDepth.assign(mSize.x*mSize.y, 0);
+	mHoleAges.assign(mSize.x*mSize.y, 0);
+	mIsPrimed = false;
+}
+
+const uint16_t* DS4DepthFilter::apply(const uint16_t *pDepth, float pAlpha, int pSnap, int pHoleFrames)
+{
+	DS4_TRACE_SCOPE("cv.denoise");
+	size_t cCount = mDepth.size();
+	if (cCount == 0)
+		return pDepth;
+	if (!mIsPrimed)
+	{
+		memcpy(&mDepth[0], pDepth, cCount*sizeof(uint16_t));
+		fill(mHoleAges.begin(), mHoleAges.end(), 0);
+		mIsPrimed = true;
+		return &mDepth[0];
+	}
+
+	//Doubled deltas have to fit in 16 bits
+	int cSnap = math<int>::clamp(pSnap, 0, 16383);
+	int cHoleFrames = math<int>::clamp(pHoleFrames, 0, 0xffff);
+	int cKeep = math<int>::clamp((int)((1.0f - pAlpha) * 32768.0f + 0.5f), 0, 32767);
+
+	size_t di = 0;
+#ifdef DS4_FILTER_SSE2
+	di = filterSSE2(pDepth, &mDepth[0], &mHoleAges[0], cCount, cKeep, cSnap, cHoleFrames);
+#endif
+	filterScalar(pDepth, &mDepth[0], &mHoleAges[0], di, cCount, cKeep, cSnap, cHoleFrames);
+	return &mDepth[0];
+}
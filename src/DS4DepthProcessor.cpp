@@ -0,0 +1,501 @@
+#include <cstring>
+#include "cinder/CinderMath.h"
+#include "DS4DepthProcessor.h"
+#include "DS4Trace.h"
+
+static const int S_TILE_SIZE = 32;
+
+DS4DepthProcessor::DS4DepthProcessor() : mSize(0, 0), mLutDepthMin(0), mLutDepthMax(0), mLutThresh(-1)
+{
+
+}
+
+DS4DepthProcessor::~DS4DepthProcessor()
+{
+
+}
+
+void DS4DepthProcessor::setup(Vec2i pSize, const DSCalibIntrinsicsRectified &pIntrinsics)
+{
+	mSize = pSize;
+	mZIntrinsics = pIntrinsics;
+	mRays.update(mSize, mZIntrinsics);
+	mDepthFilter.setup(mSize);
+	mArena.setup(mSize);
+	mDepthPixels.assign(mSize.x*mSize.y, 0);
+	mMatDiff = cv::Mat::zeros(mSize.y, mSize.x, CV_8U(1));
+	mDirtyRegions.clear();
+}
+
+void DS4DepthProcessor::process(const uint16_t *pDepth, const DS4CVParams &pParams, uint64_t pFrameNumber)
+{
+	quantize(denoise(pDepth, pParams), pParams);
+	buildCloud(pParams);
+	findContours();
+	analyzeContours(pParams);
+	collectSpawns(pParams, pFrameNumber);
+
+	DS4_TRACE_COUNTER("cloud points", mCloudPoints.size());
+	DS4_TRACE_COUNTER("contours", mContours.size());
+	DS4_TRACE_COUNTER("spawn points", mSpawnPoints.size() + mLongSpawnPoints.size());
+}
+
+// Turning the filter off drops its history, so turning it back on starts
+// from the current frame instead of a stale one
+const uint16_t* DS4DepthProcessor::denoise(const uint16_t *pDepth, const DS4CVParams &pParams)
+{
+	if (!pParams.Denoise)
+	{
+		mDepthFilter.reset();
+		return pDepth;
+	}
+	return mDepthFilter.apply(pDepth, pParams.DenoiseAlpha, pParams.DenoiseSnap, pParams.DenoiseHoleFrames);
+}
+
+// Same float lmap and > Thresh test the per-pixel loop and cv::threshold
+// used, evaluated once per depth value, so the output is bit-identical.
+void DS4DepthProcessor::updateDepthLut(const DS4CVParams &pParams)
+{
+	if (!mDepthLut.empty() && pParams.DepthMin == mLutDepthMin && pParams.DepthMax == mLutDepthMax && pParams.Thresh == mLutThresh)
+		return;
+
+	DS4_TRACE_SCOPE("cv.depthLut");
+	mDepthLut.resize(65536);
+	for (int di = 0; di < 65536; ++di)
+	{
+		float cDepthVal = (float)di;
+		uint8_t cPixel = 0;
+		if (cDepthVal > pParams.DepthMin&&cDepthVal < pParams.DepthMax)
+			cPixel = (uint8_t)(lmap<float>(cDepthVal, pParams.DepthMin, pParams.DepthMax, 255, 0));
+		uint8_t cMask = cPixel > pParams.Thresh ? 255 : 0;
+		mDepthLut[di] = (uint16_t)(cPixel | (cMask << 8));
+	}
+	mLutDepthMin = pParams.DepthMin;
+	mLutDepthMax = pParams.DepthMax;
+	mLutThresh = pParams.Thresh;
+}
+
+// The last frame's depth and mask become the previous ones by a pointer
+// swap. pDepth is copied into the arena in the same pass that reads it for
+// the lookup, since the caller may reuse its buffer before the next frame.
+void DS4DepthProcessor::quantize(const uint16_t *pDepth, const DS4CVParams &pParams)
+{
+	DS4_TRACE_SCOPE("cv.quantize");
+	mArena.swap();
+	updateDepthLut(pParams);
+
+	const uint16_t *cLut = &mDepthLut[0];
+	uint16_t *cDepth = mArena.getDepth();
+	uint8_t *cPixels = &mDepthPixels[0];
+	uint8_t *cMask = mArena.getMask();
+	int cCount = mSize.x*mSize.y;
+	int did = 0;
+	for (; did + 4 <= cCount; did += 4)
+	{
+		uint16_t cZ0 = pDepth[did], cZ1 = pDepth[did + 1], cZ2 = pDepth[did + 2], cZ3 = pDepth[did + 3];
+		cDepth[did] = cZ0; cDepth[did + 1] = cZ1; cDepth[did + 2] = cZ2; cDepth[did + 3] = cZ3;
+		uint16_t cE0 = cLut[cZ0], cE1 = cLut[cZ1], cE2 = cLut[cZ2], cE3 = cLut[cZ3];
+		cPixels[did] = (uint8_t)cE0; cPixels[did + 1] = (uint8_t)cE1; cPixels[did + 2] = (uint8_t)cE2; cPixels[did + 3] = (uint8_t)cE3;
+		cMask[did] = (uint8_t)(cE0 >> 8); cMask[did + 1] = (uint8_t)(cE1 >> 8); cMask[did + 2] = (uint8_t)(cE2 >> 8); cMask[did + 3] = (uint8_t)(cE3 >> 8);
+	}
+	for (; did < cCount; ++did)
+	{
+		cDepth[did] = pDepth[did];
+		uint16_t cEntry = cLut[pDepth[did]];
+		cPixels[did] = (uint8_t)cEntry;
+		cMask[did] = (uint8_t)(cEntry >> 8);
+	}
+}
+
+// Cloud rows are split into bands that fill their own point buffers, so
+// workers never share a vector. The bands are concatenated in row order
+// afterwards, which keeps the point order identical to a serial pass.
+// Voxel mode deprojects every masked pixel the same way, then bins the
+// bands in row order on this thread so the result is thread count independent.
+void DS4DepthProcessor::buildCloud(const DS4CVParams &pParams)
+{
+	DS4_TRACE_SCOPE("cv.cloud");
+	mCloudPoints.clear();
+	mBorderPoints.clear();
+	if (pParams.IsDebug)
+		return;
+
+	bool cVoxel = pParams.CloudMode == CLOUD_MODE_VOXEL;
+	int cStride = cVoxel ? 1 : pParams.CloudRes;
+	int cCloudRows = (mSize.y + cStride - 1) / cStride;
+	size_t cBandCount = math<size_t>::min(cCloudRows, mWorkerPool ? mWorkerPool->getThreadCount() * 4 : 1);
+	if (mBandPoints.size() < cBandCount)
+		mBandPoints.resize(cBandCount);
+
+	auto cBuildBands = [&](size_t pBegin, size_t pEnd)
+	{
+		for (size_t bi = pBegin; bi < pEnd; ++bi)
+		{
+			mBandPoints[bi].clear();
+			buildCloudRows(pParams, cStride, (int)(bi*cCloudRows / cBandCount), (int)((bi + 1)*cCloudRows / cBandCount), mBandPoints[bi]);
+		}
+	};
+	if (mWorkerPool)
+		mWorkerPool->parallelFor(cBandCount, 1, cBuildBands);
+	else
+		cBuildBands(0, cBandCount);
+
+	if (cVoxel)
+	{
+		DS4_TRACE_SCOPE("cv.voxel");
+		mVoxelGrid.setVoxelSize(pParams.VoxelSize);
+		mVoxelGrid.begin();
+		for (size_t bi = 0; bi < cBandCount; ++bi)
+		{
+			for (auto &cPoint : mBandPoints[bi])
+				mVoxelGrid.add(cPoint);
+		}
+		mVoxelGrid.getPoints(mCloudPoints);
+	}
+	else
+	{
+		size_t cTotal = 0;
+		for (size_t bi = 0; bi < cBandCount; ++bi)
+			cTotal += mBandPoints[bi].size();
+		mCloudPoints.resize(cTotal);
+		size_t cOffset = 0;
+		for (size_t bi = 0; bi < cBandCount; ++bi)
+		{
+			if (!mBandPoints[bi].empty())
+				memcpy(&mCloudPoints[cOffset], &mBandPoints[bi][0], mBandPoints[bi].size()*sizeof(Vec3f));
+			cOffset += mBandPoints[bi].size();
+		}
+	}
+
+	//Border points take every pixel of the bottom two rows
+	const uint16_t *cDepth = mArena.getDepth();
+	const uint8_t *cMask = mArena.getMask();
+	for (int dy = math<int>::max(0, mSize.y - 2); dy < mSize.y; dy++)
+	{
+		const uint16_t *cDepthRow = cDepth + dy*mSize.x;
+		const uint8_t *cMaskRow = cMask + dy*mSize.x;
+		const float *cRaysX = mRays.getRaysX(dy);
+		float cRayY = mRays.getRayY(dy);
+		for (int dx = 0; dx < mSize.x; dx++)
+		{
+			float cDepthVal = (float)cDepthRow[dx];
+			if ((cDepthVal>pParams.DepthMin&&cDepthVal < pParams.DepthMax) && cMaskRow[dx] == 255)
+				mBorderPoints.push_back(Vec3f(cRaysX[dx] * cDepthVal, -(cRayY * cDepthVal), cDepthVal));
+		}
+	}
+}
+
+// Visits only the pixels on the pStride grid, pRowBegin and pRowEnd count
+// cloud rows rather than image rows
+void DS4DepthProcessor::buildCloudRows(const DS4CVParams &pParams, int pStride, int pRowBegin, int pRowEnd, vector<Vec3f> &pPoints) const
+{
+	const uint16_t *cDepth = mArena.getDepth();
+	const uint8_t *cMask = mArena.getMask();
+	for (int ri = pRowBegin; ri < pRowEnd; ri++)
+	{
+		int dy = ri*pStride;
+		const uint16_t *cDepthRow = cDepth + dy*mSize.x;
+		const uint8_t *cMaskRow = cMask + dy*mSize.x;
+		const float *cRaysX = mRays.getRaysX(dy);
+		float cRayY = mRays.getRayY(dy);
+		for (int dx = 0; dx < mSize.x; dx += pStride)
+		{
+			float cDepthVal = (float)cDepthRow[dx];
+			if ((cDepthVal>pParams.DepthMin&&cDepthVal < pParams.DepthMax) && cMaskRow[dx] == 255)
+				pPoints.push_back(Vec3f(cRaysX[dx] * cDepthVal, -(cRayY * cDepthVal), cDepthVal));
+		}
+	}
+}
+
+// absdiff and findContours only run inside the dirty regions. A region
+// covers a connected group of changed tiles plus a one tile margin, so every
+// changed pixel lies in exactly one region with unchanged (zero diff) pixels
+// around it: contours never cross a region border and need no stitching.
+// With nothing moving there are no regions and this is just the tile test.
+// cv::findContours creates and frees its own trace storage and output
+// vectors on every call, so this goes through the C API with the arena's
+// storage and copies each trace into a point list kept from earlier frames.
+void DS4DepthProcessor::findContours()
+{
+	DS4_TRACE_SCOPE("cv.contours");
+	for (auto &cRegion : mDirtyRegions)
+		mMatDiff(cRegion).setTo(0);
+
+	findDirtyRegions();
+	CvMemStorage *cStorage = mArena.getContourStorage();
+	cvClearMemStorage(cStorage);
+	size_t cCount = 0;
+	for (auto &cRegion : mDirtyRegions)
+	{
+		cv::Mat cDiff = mMatDiff(cRegion);
+		cv::absdiff(mArena.getMaskMat()(cRegion), mArena.getPrevMaskMat()(cRegion), cDiff);
+
+		//Same mode, method and offset as cv::findContours(cDiff, ..., cRegion.tl())
+		IplImage cImage = cDiff;
+		CvSeq *cFirst = nullptr;
+		cvFindContours(&cImage, cStorage, &cFirst, sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(cRegion.x, cRegion.y));
+		for (CvSeq *cSeq = cFirst; cSeq; cSeq = cSeq->h_next)
+		{
+			if (cCount == mContours.size())
+				mArena.resizeContours(mContours, cCount + 1);
+			vector<cv::Point> &cContour = mContours[cCount++];
+			cContour.resize(cSeq->total);
+			cvCvtSeqToArray(cSeq, &cContour[0], CV_WHOLE_SEQ);
+		}
+	}
+	mArena.resizeContours(mContours, cCount);
+}
+
+// Word-wise compare of one tile row of the current and previous mask
+static bool spanChanged(const uint8_t *pCurrent, const uint8_t *pPrev, int pLength)
+{
+	uint64_t cChanged = 0;
+	int bi = 0;
+	for (; bi + 8 <= pLength; bi += 8)
+	{
+		uint64_t cCurrent, cPrev;
+		memcpy(&cCurrent, pCurrent + bi, 8);
+		memcpy(&cPrev, pPrev + bi, 8);
+		cChanged |= cCurrent ^ cPrev;
+	}
+	for (; bi < pLength; ++bi)
+		cChanged |= pCurrent[bi] ^ pPrev[bi];
+	return cChanged != 0;
+}
+
+void DS4DepthProcessor::findDirtyRegions()
+{
+	int cTilesX = (mSize.x + S_TILE_SIZE - 1) / S_TILE_SIZE;
+	int cTilesY = (mSize.y + S_TILE_SIZE - 1) / S_TILE_SIZE;
+	mDirtyTiles.assign(cTilesX*cTilesY, 0);
+	mDirtyRegions.clear();
+
+	int cDirtyCount = 0;
+	const uint8_t *cCurrent = mArena.getMask();
+	const uint8_t *cPrev = mArena.getPrevMaskMat().ptr<uint8_t>(0);
+	for (int dy = 0; dy < mSize.y; ++dy)
+	{
+		uint8_t *cTileRow = &mDirtyTiles[(dy / S_TILE_SIZE)*cTilesX];
+		for (int tx = 0; tx < cTilesX; ++tx)
+		{
+			if (cTileRow[tx])
+				continue;
+			int cBegin = dy*mSize.x + tx*S_TILE_SIZE;
+			int cLength = math<int>::min(S_TILE_SIZE, mSize.x - tx*S_TILE_SIZE);
+			if (spanChanged(cCurrent + cBegin, cPrev + cBegin, cLength))
+			{
+				cTileRow[tx] = 1;
+				++cDirtyCount;
+			}
+		}
+	}
+	DS4_TRACE_COUNTER("dirty tiles", cDirtyCount);
+	if (cDirtyCount == 0)
+		return;
+
+	//Grow by one tile, then take the bounding box of each connected group
+	vector<uint8_t> &cActive = mActiveTiles;
+	cActive.assign(mDirtyTiles.size(), 0);
+	for (int ty = 0; ty < cTilesY; ++ty)
+	{
+		for (int tx = 0; tx < cTilesX; ++tx)
+		{
+			if (!mDirtyTiles[ty*cTilesX + tx])
+				continue;
+			for (int ny = math<int>::max(0, ty - 1); ny <= math<int>::min(cTilesY - 1, ty + 1); ++ny)
+			{
+				for (int nx = math<int>::max(0, tx - 1); nx <= math<int>::min(cTilesX - 1, tx + 1); ++nx)
+					cActive[ny*cTilesX + nx] = 1;
+			}
+		}
+	}
+
+	vector<cv::Rect> &cBoxes = mTileBoxes;
+	vector<int> &cStack = mTileStack;
+	cBoxes.clear();
+	for (int ti = 0; ti < (int)cActive.size(); ++ti)
+	{
+		if (cActive[ti] != 1)
+			continue;
+		cv::Rect cBox(ti % cTilesX, ti / cTilesX, 1, 1);
+		cActive[ti] = 2;
+		cStack.push_back(ti);
+		while (!cStack.empty())
+		{
+			int cTile = cStack.back();
+			cStack.pop_back();
+			int cX = cTile % cTilesX, cY = cTile / cTilesX;
+			cBox |= cv::Rect(cX, cY, 1, 1);
+			for (int ny = math<int>::max(0, cY - 1); ny <= math<int>::min(cTilesY - 1, cY + 1); ++ny)
+			{
+				for (int nx = math<int>::max(0, cX - 1); nx <= math<int>::min(cTilesX - 1, cX + 1); ++nx)
+				{
+					if (cActive[ny*cTilesX + nx] == 1)
+					{
+						cActive[ny*cTilesX + nx] = 2;
+						cStack.push_back(ny*cTilesX + nx);
+					}
+				}
+			}
+		}
+		cBoxes.push_back(cBox);
+	}
+
+	//Boxes of separate groups can still overlap, merge until none do
+	bool cMerged = true;
+	while (cMerged)
+	{
+		cMerged = false;
+		for (size_t bi = 0; bi < cBoxes.size() && !cMerged; ++bi)
+		{
+			for (size_t bj = bi + 1; bj < cBoxes.size() && !cMerged; ++bj)
+			{
+				if ((cBoxes[bi] & cBoxes[bj]).area() > 0)
+				{
+					cBoxes[bi] |= cBoxes[bj];
+					cBoxes.erase(cBoxes.begin() + bj);
+					cMerged = true;
+				}
+			}
+		}
+	}
+
+	cv::Rect cImage(0, 0, mSize.x, mSize.y);
+	for (auto &cBox : cBoxes)
+		mDirtyRegions.push_back(cv::Rect(cBox.x*S_TILE_SIZE, cBox.y*S_TILE_SIZE, cBox.width*S_TILE_SIZE, cBox.height*S_TILE_SIZE) & cImage);
+}
+
+// The mask flags are read straight from the arena's buffers, contour points
+// always lie inside the image
+void DS4DepthProcessor::analyzeContours(const DS4CVParams &pParams)
+{
+	DS4_TRACE_SCOPE("cv.analyze");
+	mAnalysis.Contours.resize(mContours.size());
+	mAnalysis.PointFlags.clear();
+
+	const uint8_t *cMask = mArena.getMask();
+	const uint8_t *cPrevMask = mArena.getPrevMaskMat().ptr<uint8_t>(0);
+	for (size_t ci = 0; ci < mContours.size(); ++ci)
+	{
+		const vector<cv::Point> &cContour = mContours[ci];
+		DS4ContourInfo &cInfo = mAnalysis.Contours[ci];
+		cInfo.Area = cv::contourArea(cContour, false);
+		cInfo.Passed = cInfo.Area > pParams.SizeMin;
+		cInfo.FlagsBegin = mAnalysis.PointFlags.size();
+		if (!cInfo.Passed)
+			continue;
+
+		cInfo.Bounds = cv::boundingRect(cContour);
+
+		mAnalysis.PointFlags.resize(cInfo.FlagsBegin + cContour.size());
+		uint8_t *cFlags = &mAnalysis.PointFlags[cInfo.FlagsBegin];
+		for (size_t vi = 0; vi < cContour.size(); ++vi)
+		{
+			int cId = cContour[vi].y*mSize.x + cContour[vi].x;
+			cFlags[vi] = (cPrevMask[cId] == 255 ? CONTOUR_POINT_PREV : 0) | (cMask[cId] == 255 ? CONTOUR_POINT_CURRENT : 0);
+		}
+	}
+}
+
+void DS4DepthProcessor::collectSpawns(const DS4CVParams &pParams, uint64_t pFrameNumber)
+{
+	DS4_TRACE_SCOPE("cv.spawn");
+	mContourPoints.clear();
+	mSpawnPoints.clear();
+	mLongSpawnPoints.clear();
+
+	bool cIsSpawnFrame = !pParams.IsDebug && (pFrameNumber % pParams.FramesSpawn == 0) && pParams.Level > pParams.SpawnLevel;
+	const uint16_t *cDepth = mArena.getDepth();
+	const uint16_t *cPrevDepth = mArena.getPrevDepth();
+	for (size_t ci = 0; ci < mContours.size(); ++ci)
+	{
+		const DS4ContourInfo &cInfo = mAnalysis.Contours[ci];
+		if (cInfo.Passed)
+		{
+			const vector<cv::Point> &cContour = mContours[ci];
+			const uint8_t *cFlags = &mAnalysis.PointFlags[cInfo.FlagsBegin];
+			for (int vi = 0; vi < cContour.size(); vi++)
+			{
+				const cv::Point &cPoint = cContour[vi];
+				if (cFlags[vi] & CONTOUR_POINT_PREV)
+				{
+					if (cIsSpawnFrame && (vi % pParams.SpawnRes == 0))
+					{
+						uint16_t cZ = cPrevDepth[cPoint.y*mSize.x + cPoint.x];
+						if (cZ>pParams.DepthMin&&cZ < pParams.DepthMax)
+						{
+							Vec3f cOutPoint = mRays.deproject(cPoint.x, cPoint.y, cZ);
+							if (cOutPoint.y < 50)
+							{
+								if (vi % 20 == 0)
+									mLongSpawnPoints.push_back(Vec3f(cOutPoint.x, -cOutPoint.y, cOutPoint.z));
+								else
+									mSpawnPoints.push_back(Vec3f(cOutPoint.x, -cOutPoint.y, cOutPoint.z));
+							}
+						}
+					}
+				}
+				if (vi % pParams.BoltRes == 0 && (cFlags[vi] & CONTOUR_POINT_CURRENT))
+				{
+					uint16_t cZ2 = cDepth[cPoint.y*mSize.x + cPoint.x];
+					if (cZ2 > pParams.DepthMin&&cZ2 < pParams.DepthMax)
+					{
+						Vec3f cOutPoint2 = mRays.deproject(cPoint.x, cPoint.y, cZ2);
+						mContourPoints.push_back(Vec3f(cOutPoint2.x, -cOutPoint2.y, cOutPoint2.z));
+					}
+				}
+			}
+		}
+	}
+}
+
+void DS4DepthProcessor::emit(DS4ParticleSystem &pSystem, const DS4CVParams &pParams, uint64_t pFrameNumber)
+{
+	emit(mSpawnPoints, mLongSpawnPoints, pSystem, pParams, pFrameNumber);
+}
+
+// Long lived particles turn to mica on every 90th frame. Velocities are the
+// old per-frame values scaled to mm per second at 60 Hz. The long lived
+// batch goes first: with the pool nearly full, a short lived batch first
+// would take every free slot and drop all the long lived and mica ones,
+// where the old per-point loop only lost whichever points came last.
+void DS4DepthProcessor::emit(const vector<Vec3f> &pSpawnPoints, const vector<Vec3f> &pLongSpawnPoints, DS4ParticleSystem &pSystem, const DS4CVParams &pParams, uint64_t pFrameNumber)
+{
+	DS4_TRACE_SCOPE("cv.emit");
+	DS4EmitParams cShort = { Vec3f(-9.0f, -360.0f, -60.0f), Vec3f(9.0f, -120.0f, 0.0f), Vec2f(pParams.LifeMin, pParams.LifeMax), pParams.ParticleAlpha, 0.0f };
+	DS4EmitParams cLong = { Vec3f(-9.0f, -354.0f, -60.0f), Vec3f(9.0f, -90.0f, 0.0f), Vec2f(3.0f, 3.0f), pParams.ParticleAlpha, pFrameNumber % 90 == 0 ? 1.0f : 0.0f };
+	pSystem.emit(pLongSpawnPoints.data(), pLongSpawnPoints.size(), cLong);
+	pSystem.emit(pSpawnPoints.data(), pSpawnPoints.size(), cShort);
+}
+
+// The processor gets the recycled result's old vectors back in the swap, so
+// both sides keep their capacity. copyTo() only allocates the debug images
+// when the result has none of that size yet.
+DS4FrameResultRef DS4DepthProcessor::takeResult(const DS4CVParams &pParams, uint64_t pFrameNumber)
+{
+	shared_ptr<DS4FrameResult> cResult = mArena.acquireResult();
+	cResult->FrameNumber = pFrameNumber;
+	cResult->Params = pParams;
+	cResult->CloudPoints.swap(mCloudPoints);
+	cResult->ContourPoints.swap(mContourPoints);
+	cResult->BorderPoints.swap(mBorderPoints);
+	cResult->SpawnPoints.swap(mSpawnPoints);
+	cResult->LongSpawnPoints.swap(mLongSpawnPoints);
+	cResult->Contours.swap(mContours);
+	cResult->Analysis.Contours.swap(mAnalysis.Contours);
+	cResult->Analysis.PointFlags.swap(mAnalysis.PointFlags);
+	cResult->DirtyRegions = mDirtyRegions;
+	if (pParams.IsDebug)
+	{
+		//The mask buffer is rewritten next frame and findContours scribbles
+		//over the diff, so the debug view gets its own copies
+		mArena.getMaskMat().copyTo(cResult->Mask);
+		mMatDiff.copyTo(cResult->Diff);
+	}
+	else
+	{
+		cResult->Mask.release();
+		cResult->Diff.release();
+	}
+	return cResult;
+}
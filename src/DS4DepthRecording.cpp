@@ -0,0 +1,347 @@
+#include <cstring>
+#include "DS4DepthRecording.h"
+
+namespace bip = boost::interprocess;
+
+static const char S_HEADER_MAGIC[4] = { 'D', 'S', '4', 'R' };
+static const char S_FOOTER_MAGIC[8] = { 'D', 'S', '4', 'R', 'I', 'D', 'X', '1' };
+static const uint32_t S_VERSION = 1;
+
+static_assert(sizeof(DS4RecordingHeader) == 64, "DS4RecordingHeader layout changed");
+static_assert(sizeof(DS4RecordingIndexEntry) == 32, "DS4RecordingIndexEntry layout changed");
+static_assert(sizeof(DS4RecordingFooter) == 24, "DS4RecordingFooter layout changed");
+
+#pragma region Codec
+static inline void putVarint(vector<uint8_t> &pOut, uint32_t pValue)
+{
+	while (pValue >= 0x80)
+	{
+		pOut.push_back(static_cast<uint8_t>(pValue | 0x80));
+		pValue >>= 7;
+	}
+	pOut.push_back(static_cast<uint8_t>(pValue));
+}
+
+static inline bool getVarint(const uint8_t *&pData, const uint8_t *pEnd, uint32_t &pValue)
+{
+	pValue = 0;
+	for (int cShift = 0; cShift < 35; cShift += 7)
+	{
+		if (pData == pEnd)
+			return false;
+		uint8_t cByte = *pData++;
+		pValue |= static_cast<uint32_t>(cByte & 0x7f) << cShift;
+		if (!(cByte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// Frame-to-frame depth residuals are mostly zero (static scene) or small
+// (sensor noise), so they are zigzagged and stored as zero runs followed by
+// one non-zero value.
+static void encodeFrame(const uint16_t *pFrame, const uint16_t *pPrev, size_t pCount, vector<uint8_t> &pOut)
+{
+	pOut.clear();
+	uint32_t cRun = 0;
+	for (size_t pi = 0; pi < pCount; ++pi)
+	{
+		uint16_t cDelta = static_cast<uint16_t>(pFrame[pi] - (pPrev ? pPrev[pi] : 0));
+		if (cDelta == 0)
+		{
+			++cRun;
+			continue;
+		}
+
+		int16_t cSigned = static_cast<int16_t>(cDelta);
+		uint16_t cZigzag = static_cast<uint16_t>((cSigned << 1) ^ (cSigned >> 15));
+		putVarint(pOut, cRun);
+		putVarint(pOut, cZigzag);
+		cRun = 0;
+	}
+	putVarint(pOut, cRun);
+}
+
+// Applies an encoded frame on top of pFrame, which holds the previous frame
+// (or zeros for a keyframe).
+static bool decodeFrame(const uint8_t *pData, size_t pSize, uint16_t *pFrame, size_t pCount)
+{
+	const uint8_t *cEnd = pData + pSize;
+	size_t pi = 0;
+	for (;;)
+	{
+		uint32_t cRun, cZigzag;
+		if (!getVarint(pData, cEnd, cRun))
+			return false;
+		pi += cRun;
+		if (pi >= pCount)
+			return pi == pCount && pData == cEnd;
+		if (!getVarint(pData, cEnd, cZigzag))
+			return false;
+
+		int16_t cSigned = static_cast<int16_t>((cZigzag >> 1) ^ (~(cZigzag & 1) + 1));
+		pFrame[pi] = static_cast<uint16_t>(pFrame[pi] + cSigned);
+		++pi;
+	}
+}
+#pragma endregion Codec
+
+#pragma region DS4DepthRecorder
+DS4DepthRecorder::DS4DepthRecorder() : mKeyInterval(60), mIsRecording(false), mQuit(false)
+{
+	mFramesWritten = 0;
+	mFramesDropped = 0;
+	mBytesWritten = 0;
+}
+
+DS4DepthRecorder::~DS4DepthRecorder()
+{
+	stop();
+}
+
+bool DS4DepthRecorder::start(const string &pPath, Vec2i pSize, const DSCalibIntrinsicsRectified &pIntrinsics, float pFPS, uint32_t pKeyInterval, size_t pQueueDepth)
+{
+	stop();
+	mFile.open(pPath.c_str(), ios::binary | ios::trunc);
+	if (!mFile)
+		return false;
+
+	DS4RecordingHeader cHeader;
+	memset(&cHeader, 0, sizeof(cHeader));
+	memcpy(cHeader.Magic, S_HEADER_MAGIC, sizeof(S_HEADER_MAGIC));
+	cHeader.Version = S_VERSION;
+	cHeader.Width = pSize.x;
+	cHeader.Height = pSize.y;
+	cHeader.FPS = pFPS;
+	cHeader.Rfx = pIntrinsics.rfx;
+	cHeader.Rfy = pIntrinsics.rfy;
+	cHeader.Rpx = pIntrinsics.rpx;
+	cHeader.Rpy = pIntrinsics.rpy;
+	cHeader.KeyInterval = pKeyInterval > 0 ? pKeyInterval : 1;
+	mFile.write(reinterpret_cast<const char*>(&cHeader), sizeof(cHeader));
+
+	mSize = pSize;
+	mKeyInterval = cHeader.KeyInterval;
+	mSlots.resize(pQueueDepth);
+	mFree.clear();
+	mPending.clear();
+	for (size_t si = 0; si < mSlots.size(); ++si)
+	{
+		mSlots[si].Pixels.resize(pSize.x*pSize.y);
+		mFree.push_back(si);
+	}
+	mPrevFrame.assign(pSize.x*pSize.y, 0);
+	mIndex.clear();
+	mFramesWritten = 0;
+	mFramesDropped = 0;
+	mBytesWritten = sizeof(cHeader);
+
+	mQuit = false;
+	mIsRecording = true;
+	mWriter = thread(&DS4DepthRecorder::writerLoop, this);
+	return true;
+}
+
+bool DS4DepthRecorder::push(const uint16_t *pFrame, double pTime, uint64_t pFrameNumber)
+{
+	if (!mIsRecording)
+		return false;
+
+	size_t cSlot;
+	{
+		lock_guard<mutex> cLock(mMutex);
+		if (mFree.empty())
+		{
+			++mFramesDropped;
+			return false;
+		}
+		cSlot = mFree.front();
+		mFree.pop_front();
+	}
+
+	Slot &cDst = mSlots[cSlot];
+	memcpy(cDst.Pixels.data(), pFrame, cDst.Pixels.size()*sizeof(uint16_t));
+	cDst.Time = pTime;
+	cDst.FrameNumber = pFrameNumber;
+
+	{
+		lock_guard<mutex> cLock(mMutex);
+		mPending.push_back(cSlot);
+	}
+	mCond.notify_one();
+	return true;
+}
+
+void DS4DepthRecorder::stop()
+{
+	if (!mIsRecording)
+		return;
+
+	{
+		lock_guard<mutex> cLock(mMutex);
+		mQuit = true;
+	}
+	mCond.notify_one();
+	mWriter.join();
+
+	//Index goes after the last frame, padded so it can be mapped in place
+	uint64_t cOffset = mBytesWritten;
+	while (cOffset % 8 != 0)
+	{
+		mFile.put(0);
+		++cOffset;
+	}
+	if (!mIndex.empty())
+		mFile.write(reinterpret_cast<const char*>(mIndex.data()), mIndex.size()*sizeof(DS4RecordingIndexEntry));
+
+	DS4RecordingFooter cFooter;
+	cFooter.IndexOffset = cOffset;
+	cFooter.FrameCount = mIndex.size();
+	memcpy(cFooter.Magic, S_FOOTER_MAGIC, sizeof(S_FOOTER_MAGIC));
+	mFile.write(reinterpret_cast<const char*>(&cFooter), sizeof(cFooter));
+	mFile.close();
+	mIsRecording = false;
+}
+
+void DS4DepthRecorder::writerLoop()
+{
+	for (;;)
+	{
+		size_t cSlot;
+		{
+			unique_lock<mutex> cLock(mMutex);
+			mCond.wait(cLock, [this]{ return mQuit || !mPending.empty(); });
+			if (mPending.empty())
+				return;
+			cSlot = mPending.front();
+			mPending.pop_front();
+		}
+
+		writeFrame(mSlots[cSlot]);
+
+		lock_guard<mutex> cLock(mMutex);
+		mFree.push_back(cSlot);
+	}
+}
+
+void DS4DepthRecorder::writeFrame(const Slot &pSlot)
+{
+	bool cIsKey = (mIndex.size() % mKeyInterval) == 0;
+	encodeFrame(pSlot.Pixels.data(), cIsKey ? nullptr : mPrevFrame.data(), pSlot.Pixels.size(), mEncoded);
+	memcpy(mPrevFrame.data(), pSlot.Pixels.data(), mPrevFrame.size()*sizeof(uint16_t));
+
+	DS4RecordingIndexEntry cEntry;
+	cEntry.Offset = mBytesWritten;
+	cEntry.FrameNumber = pSlot.FrameNumber;
+	cEntry.Time = pSlot.Time;
+	cEntry.Size = static_cast<uint32_t>(mEncoded.size());
+	cEntry.IsKey = cIsKey ? 1 : 0;
+	mIndex.push_back(cEntry);
+
+	mFile.write(reinterpret_cast<const char*>(mEncoded.data()), mEncoded.size());
+	mBytesWritten += mEncoded.size();
+	++mFramesWritten;
+}
+#pragma endregion DS4DepthRecorder
+
+#pragma region DS4DepthRecordingReader
+DS4DepthRecordingReader::DS4DepthRecordingReader() : mData(nullptr), mDataSize(0), mIndex(nullptr), mFrameCount(0), mLastDecoded(0)
+{
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+bool DS4DepthRecordingReader::open(const string &pPath)
+{
+	close();
+	try
+	{
+		mMapping = bip::file_mapping(pPath.c_str(), bip::read_only);
+		mRegion = bip::mapped_region(mMapping, bip::read_only);
+	}
+	catch (bip::interprocess_exception &)
+	{
+		return false;
+	}
+
+	mData = static_cast<const uint8_t*>(mRegion.get_address());
+	mDataSize = mRegion.get_size();
+	if (mDataSize < sizeof(DS4RecordingHeader) + sizeof(DS4RecordingFooter))
+		return false;
+
+	memcpy(&mHeader, mData, sizeof(mHeader));
+	if (memcmp(mHeader.Magic, S_HEADER_MAGIC, sizeof(S_HEADER_MAGIC)) != 0 || mHeader.Version != S_VERSION || mHeader.KeyInterval == 0)
+		return false;
+
+	DS4RecordingFooter cFooter;
+	memcpy(&cFooter, mData + mDataSize - sizeof(cFooter), sizeof(cFooter));
+	if (memcmp(cFooter.Magic, S_FOOTER_MAGIC, sizeof(S_FOOTER_MAGIC)) != 0)
+		return false;
+	if (cFooter.IndexOffset % 8 != 0 || cFooter.IndexOffset + cFooter.FrameCount*sizeof(DS4RecordingIndexEntry) + sizeof(cFooter) != mDataSize)
+		return false;
+
+	mIndex = reinterpret_cast<const DS4RecordingIndexEntry*>(mData + cFooter.IndexOffset);
+	mFrameCount = static_cast<size_t>(cFooter.FrameCount);
+	mLastFrame.assign(mHeader.Width*mHeader.Height, 0);
+	mLastDecoded = mFrameCount;
+	return true;
+}
+
+void DS4DepthRecordingReader::close()
+{
+	mRegion = bip::mapped_region();
+	mMapping = bip::file_mapping();
+	mData = nullptr;
+	mDataSize = 0;
+	mIndex = nullptr;
+	mFrameCount = 0;
+}
+
+DSCalibIntrinsicsRectified DS4DepthRecordingReader::getIntrinsics() const
+{
+	DSCalibIntrinsicsRectified cIntrinsics;
+	cIntrinsics.rfx = mHeader.Rfx;
+	cIntrinsics.rfy = mHeader.Rfy;
+	cIntrinsics.rpx = mHeader.Rpx;
+	cIntrinsics.rpy = mHeader.Rpy;
+	cIntrinsics.rw = mHeader.Width;
+	cIntrinsics.rh = mHeader.Height;
+	return cIntrinsics;
+}
+
+bool DS4DepthRecordingReader::readFrame(size_t pFrame, uint16_t *pPixels)
+{
+	if (pFrame >= mFrameCount)
+		return false;
+
+	//Decoding starts at the keyframe, or continues from the last decoded frame
+	//when that lies between the keyframe and the target
+	size_t cFirst = pFrame;
+	while (cFirst > 0 && !mIndex[cFirst].IsKey)
+		--cFirst;
+	if (mLastDecoded < mFrameCount && mLastDecoded >= cFirst && mLastDecoded <= pFrame)
+		cFirst = mLastDecoded + 1;
+
+	for (size_t fi = cFirst; fi <= pFrame; ++fi)
+	{
+		if (!decode(fi, mLastFrame.data()))
+		{
+			mLastDecoded = mFrameCount;
+			return false;
+		}
+		mLastDecoded = fi;
+	}
+
+	memcpy(pPixels, mLastFrame.data(), mLastFrame.size()*sizeof(uint16_t));
+	return true;
+}
+
+bool DS4DepthRecordingReader::decode(size_t pFrame, uint16_t *pPixels)
+{
+	const DS4RecordingIndexEntry &cEntry = mIndex[pFrame];
+	if (cEntry.Offset + cEntry.Size > mDataSize)
+		return false;
+	if (cEntry.IsKey)
+		memset(pPixels, 0, mLastFrame.size()*sizeof(uint16_t));
+	return decodeFrame(mData + cEntry.Offset, cEntry.Size, pPixels, mLastFrame.size());
+}
+#pragma endregion DS4DepthRecordingReader
@@ -0,0 +1,72 @@
+#include <atomic>
+#include "DS4DepthProcessor.h"
+#include "DS4FrameArena.h"
+
+//Parked contour lists the spare list holds before it has to grow
+static const size_t S_SPARE_CONTOURS = 1024;
+
+DS4FrameArena::DS4FrameArena() : mSize(0, 0), mCurrent(0), mContourStorage(cvCreateMemStorage(0))
+{
+
+}
+
+DS4FrameArena::~DS4FrameArena()
+{
+	cvReleaseMemStorage(&mContourStorage);
+}
+
+void DS4FrameArena::setup(Vec2i pSize)
+{
+	mSize = pSize;
+	mCurrent = 0;
+	for (int bi = 0; bi < 2; ++bi)
+	{
+		mDepth[bi].assign(mSize.x*mSize.y, 0);
+		mMask[bi].assign(mSize.x*mSize.y, 0);
+		mMaskMat[bi] = cv::Mat(mSize.y, mSize.x, CV_8U(1), mMask[bi].data());
+	}
+	cvClearMemStorage(mContourStorage);
+	mSpareContours.reserve(S_SPARE_CONTOURS);
+}
+
+void DS4FrameArena::swap()
+{
+	mCurrent = 1 - mCurrent;
+}
+
+void DS4FrameArena::resizeContours(vector<vector<cv::Point>> &pContours, size_t pCount)
+{
+	while (pContours.size() > pCount)
+	{
+		mSpareContours.push_back(vector<cv::Point>());
+		mSpareContours.back().swap(pContours.back());
+		mSpareContours.back().clear();
+		pContours.pop_back();
+	}
+	while (pContours.size() < pCount)
+	{
+		pContours.push_back(vector<cv::Point>());
+		if (!mSpareContours.empty())
+		{
+			pContours.back().swap(mSpareContours.back());
+			mSpareContours.pop_back();
+		}
+	}
+}
+
+// A use count of one means only the pool holds the result. Other threads
+// can only drop references to it from there, never add one, so the entry
+// is safe to refill; the fence orders the refill after their last reads.
+shared_ptr<DS4FrameResult> DS4FrameArena::acquireResult()
+{
+	for (auto &cResult : mResults)
+	{
+		if (cResult.use_count() == 1)
+		{
+			atomic_thread_fence(memory_order_acquire);
+			return cResult;
+		}
+	}
+	mResults.push_back(make_shared<DS4FrameResult>());
+	return mResults.back();
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include "DS4GLPointBackend.h"
+#include "DS4Trace.h"
+
+#pragma region Immediate
+void DS4ImmediatePointBackend::drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize)
+{
+	glPointSize(pPointSize);
+	gl::color(pColor);
+	gl::begin(GL_POINTS);
+	for (size_t pi = 0; pi < pCount; ++pi)
+		gl::vertex(pPoints[pi]);
+	gl::end();
+
+	mStats.Draws++;
+	mStats.Vertices += pCount;
+}
+
+void DS4ImmediatePointBackend::drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize)
+{
+	glPointSize(pPointSize);
+	gl::begin(GL_POINTS);
+	for (size_t pi = 0; pi < pCount; ++pi)
+	{
+		gl::color(pColors[pi]);
+		gl::vertex(pPoints[pi]);
+	}
+	gl::end();
+
+	mStats.Draws++;
+	mStats.Vertices += pCount;
+}
+#pragma endregion Immediate
+
+#pragma region Stream
+DS4StreamPointBackend::DS4StreamPointBackend(size_t pCapacity) : mBuffer(0), mCapacity(pCapacity), mOffset(0)
+{
+
+}
+
+DS4StreamPointBackend::~DS4StreamPointBackend()
+{
+	if (mBuffer)
+		glDeleteBuffers(1, &mBuffer);
+}
+
+void DS4StreamPointBackend::drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize)
+{
+	submit(pPoints, nullptr, pColor, pCount, pPointSize);
+}
+
+void DS4StreamPointBackend::drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize)
+{
+	submit(pPoints, pColors, ColorA::white(), pCount, pPointSize);
+}
+
+void DS4StreamPointBackend::submit(const Vec3f *pPoints, const ColorA *pColors, const ColorA &pColor, size_t pCount, float pPointSize)
+{
+	if (pCount == 0)
+		return;
+
+	DS4_TRACE_SCOPE("points.stream");
+	size_t cBytes = getPackedSize(pCount, pColors != nullptr);
+	if (mBuffer == 0)
+	{
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+		glBufferData(GL_ARRAY_BUFFER, mCapacity, nullptr, GL_STREAM_DRAW);
+	}
+	else
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+
+	if (mOffset + cBytes > mCapacity)
+	{
+		mCapacity = max(mCapacity, cBytes);
+		glBufferData(GL_ARRAY_BUFFER, mCapacity, nullptr, GL_STREAM_DRAW);
+		mOffset = 0;
+		mStats.Orphans++;
+	}
+
+	uint8_t *cDst = static_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, mOffset, cBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	if (cDst)
+	{
+		pack(cDst, pPoints, pColors, pCount);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	else
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, mOffset, pCount*sizeof(Vec3f), pPoints);
+		if (pColors)
+			glBufferSubData(GL_ARRAY_BUFFER, mOffset + pCount*sizeof(Vec3f), pCount*sizeof(ColorA), pColors);
+	}
+
+	glPointSize(pPointSize);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, reinterpret_cast<const GLvoid*>(mOffset));
+	if (pColors)
+	{
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(4, GL_FLOAT, 0, reinterpret_cast<const GLvoid*>(mOffset + pCount*sizeof(Vec3f)));
+	}
+	else
+		gl::color(pColor);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)pCount);
+	if (pColors)
+		glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//Keep every layer's start 16 byte aligned
+	mOffset += (cBytes + 15) & ~(size_t)15;
+	mStats.Draws++;
+	mStats.Vertices += pCount;
+	mStats.Bytes += cBytes;
+}
+#pragma endregion Stream
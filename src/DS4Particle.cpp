@@ -1,45 +1,49 @@
+#include <cmath>
+#include <cstring>
 #include "DS4Particle.h"
-#include "cinder/gl/gl.h"
+#include "DS4Trace.h"
 
 #pragma region DS4Particle
-DS4Particle::DS4Particle()
-{
-
-}
-
-DS4Particle::DS4Particle(Vec3f pPos, Vec3f pVel, int pAge, float pMaxAlpha, bool pIsMica) : PPosition(pPos), PVelocity(pVel), IsActive(true), mAge(pAge), mLife(pAge), IsMica(pIsMica)
+static void getParticleColors(float pAlpha, bool pIsMica, ColorA &pStart, ColorA &pEnd)
 {
-	float cAlpha = randFloat(0.1f, pMaxAlpha);
-	mStartColor = ColorA(222 / 255.0f, 190 / 255.0f, 131 / 255.0f, cAlpha);
-	mEndColor = ColorA(138 / 255.0f, 109 / 255.0f, 78 / 255.0f, cAlpha*0.1f);
 	if (pIsMica)
 	{
-		mStartColor = ColorA(1, 1, 1, 1);
-		mEndColor = ColorA(0, 0, 0, 0.25f);
+		pStart = ColorA(1, 1, 1, 1);
+		pEnd = ColorA(0, 0, 0, 0.25f);
+	}
+	else
+	{
+		pStart = ColorA(222 / 255.0f, 190 / 255.0f, 131 / 255.0f, pAlpha);
+		pEnd = ColorA(138 / 255.0f, 109 / 255.0f, 78 / 255.0f, pAlpha*0.1f);
 	}
-	PColor = mStartColor;
 }
 
-void DS4Particle::step()
+DS4Particle::DS4Particle()
 {
-	mAge -= 1;
-	if (mAge <= 0)
-		IsActive = false;
-	if (IsActive)
-	{
-		PPosition += PVelocity;
-		PVelocity *= 1.0001f;
-		
-		float cLife = mAge / static_cast<float>(mLife);
-		PColor = mEndColor.lerp(cLife, mStartColor);
-	}
+
+}
+
+DS4Particle::DS4Particle(Vec3f pPos, Vec3f pVel, float pLife, float pAlpha, bool pIsMica) : IsMica(pIsMica), PPosition(pPos), PVelocity(pVel), mAge(pLife), mLife(pLife)
+{
+	getParticleColors(pAlpha, pIsMica, mStartColor, mEndColor);
+	PColor = mStartColor;
 }
 #pragma endregion DS4Particle
 
 #pragma region DS4ParticleSystem
-DS4ParticleSystem::DS4ParticleSystem()
+static_assert(sizeof(Vec3f) == 3 * sizeof(float), "DS4ParticleArrays expects packed Vec3f");
+static_assert(sizeof(ColorA) == 4 * sizeof(float), "DS4ParticleArrays expects packed ColorA");
+
+// Velocity falls off by 1.0001 per 60 Hz tick, the rate the app used to
+// step at once per frame
+static float getDamping(float pDt)
 {
+	return powf(1.0001f, pDt * 60.0f);
+}
 
+DS4ParticleSystem::DS4ParticleSystem() : mCount(0), mCapacity(0), mLimit(0), mChunkSize(4096), mRandom(1, RANDOM_STREAM_PARTICLES)
+{
+	setKernelLevel(DS4GetBestKernelLevel());
 }
 
 DS4ParticleSystem::~DS4ParticleSystem()
@@ -47,40 +51,205 @@ DS4ParticleSystem::~DS4ParticleSystem()
 
 }
 
-void DS4ParticleSystem::step()
+void DS4ParticleSystem::setCapacity(size_t pCapacity)
+{
+	mPositions.resize(pCapacity);
+	mPrevPositions.resize(pCapacity);
+	mDrawPositions.resize(pCapacity);
+	mVelocities.resize(pCapacity);
+	mColors.resize(pCapacity);
+	mStartColors.resize(pCapacity);
+	mEndColors.resize(pCapacity);
+	mAges.resize(pCapacity);
+	mLives.resize(pCapacity);
+	mEmitAlphas.resize(pCapacity);
+	mEmitMica.resize(pCapacity);
+
+	mCapacity = pCapacity;
+	mLimit = pCapacity;
+	mCount = math<size_t>::min(mCount, mCapacity);
+}
+
+void DS4ParticleSystem::setLimit(size_t pLimit)
 {
-	for (auto pit = mParticles.begin(); pit != mParticles.end();)
+	mLimit = math<size_t>::min(pLimit, mCapacity);
+}
+
+void DS4ParticleSystem::setKernelLevel(DS4KernelLevel pLevel)
+{
+	if (pLevel > DS4GetBestKernelLevel())
+		pLevel = DS4GetBestKernelLevel();
+	mKernelLevel = pLevel;
+	mStepKernel = DS4GetStepKernel(mKernelLevel);
+}
+
+void DS4ParticleSystem::setWorkerPool(DS4WorkerPoolRef pPool, size_t pChunkSize)
+{
+	mWorkerPool = pPool;
+	mChunkSize = pChunkSize;
+}
+
+DS4ParticleArrays DS4ParticleSystem::getArrays()
+{
+	DS4ParticleArrays cArrays = {
+		&mPositions[0].x, &mPrevPositions[0].x, &mVelocities[0].x, &mColors[0].r,
+		&mStartColors[0].r, &mEndColors[0].r,
+		&mAges[0], &mLives[0]
+	};
+	return cArrays;
+}
+
+void DS4ParticleSystem::step(float pDt)
+{
+	DS4_TRACE_SCOPE("particles.step");
+	//Retire what expired last step before integrating, so a particle is
+	//still drawn on the frame its age runs out, as it was before
+	retire();
+	if (mCount > 0)
 	{
-		if (!pit->IsActive)
-			pit = mParticles.erase(pit);
+		DS4ParticleArrays cArrays = getArrays();
+		float cDamping = getDamping(pDt);
+		if (mWorkerPool && mCount > mChunkSize)
+		{
+			DS4StepKernel cKernel = mStepKernel;
+			mWorkerPool->parallelFor(mCount, mChunkSize, [&](size_t pBegin, size_t pEnd)
+			{
+				cKernel(cArrays, pBegin, pEnd, pDt, cDamping);
+			});
+		}
 		else
+			mStepKernel(cArrays, 0, mCount, pDt, cDamping);
+	}
+	DS4_TRACE_COUNTER("live particles", mCount);
+}
+
+// Swap every expired particle with the last live one. Each retirement is O(1),
+// so a frame that expires thousands of particles costs O(dead) moves.
+void DS4ParticleSystem::retire()
+{
+	DS4_TRACE_SCOPE("particles.retire");
+	size_t pi = 0;
+	while (pi < mCount)
+	{
+		if (mAges[pi] > 0)
 		{
-			pit->step();
-			++pit;
+			++pi;
+			continue;
+		}
+
+		size_t cLast = --mCount;
+		if (pi != cLast)
+		{
+			mPositions[pi] = mPositions[cLast];
+			mPrevPositions[pi] = mPrevPositions[cLast];
+			mVelocities[pi] = mVelocities[cLast];
+			mColors[pi] = mColors[cLast];
+			mStartColors[pi] = mStartColors[cLast];
+			mEndColors[pi] = mEndColors[cLast];
+			mAges[pi] = mAges[cLast];
+			mLives[pi] = mLives[cLast];
 		}
 	}
 }
 
-void DS4ParticleSystem::display()
+// Stress helper: mark pCount live particles as expired so the next step()
+// has to retire them all in one frame.
+void DS4ParticleSystem::expire(size_t pCount)
+{
+	size_t cCount = math<size_t>::min(pCount, mCount);
+	for (size_t pi = 0; pi < cCount; ++pi)
+		mAges[pi * mCount / cCount] = 0.0f;
+}
+
+void DS4ParticleSystem::display(DS4PointBackend &pBackend, float pPointSize, float pAlpha)
 {
-	gl::begin(GL_POINTS);
-	for (auto p : mParticles)
+	DS4_TRACE_SCOPE("particles.display");
+	const Vec3f *cPositions = mPositions.data();
+	if (pAlpha < 1.0f && mCount > 0)
 	{
-		gl::color(p.PColor);
-		gl::vertex(p.PPosition);
+		interpolate(pAlpha);
+		cPositions = mDrawPositions.data();
 	}
-	gl::end();
+	pBackend.drawPoints(cPositions, mColors.data(), mCount, pPointSize);
+}
+
+void DS4ParticleSystem::interpolate(float pAlpha)
+{
+	DS4_TRACE_SCOPE("particles.interpolate");
+	const float *cPrev = &mPrevPositions[0].x;
+	const float *cCurrent = &mPositions[0].x;
+	float *cDraw = &mDrawPositions[0].x;
+	auto cLerp = [=](size_t pBegin, size_t pEnd)
+	{
+		for (size_t fi = pBegin * 3; fi < pEnd * 3; ++fi)
+			cDraw[fi] = cPrev[fi] + (cCurrent[fi] - cPrev[fi]) * pAlpha;
+	};
+	if (mWorkerPool && mCount > mChunkSize)
+		mWorkerPool->parallelFor(mCount, mChunkSize, cLerp);
+	else
+		cLerp(0, mCount);
 }
 
-void DS4ParticleSystem::add(Vec3f pPos, Vec3f pVel, Vec2i pAge, float pAlpha, bool pIsMica)
+bool DS4ParticleSystem::add(Vec3f pPos, Vec3f pVel, Vec2f pLife, float pAlpha, bool pIsMica)
 {
-	int cAge = randInt(pAge.x, pAge.y);
-	mParticles.push_back(DS4Particle(pPos, pVel, cAge, pAlpha, pIsMica));
+	if (mCount >= mLimit)
+		return false;
+	float cLife = mRandom.nextFloat(pLife.x, pLife.y);
+	return add(DS4Particle(pPos, pVel, cLife, mRandom.nextFloat(0.1f, pAlpha), pIsMica));
 }
 
-void DS4ParticleSystem::add(DS4Particle pParticle)
+bool DS4ParticleSystem::add(DS4Particle pParticle)
 {
-	mParticles.push_back(pParticle);
+	if (mCount >= mLimit)
+		return false;
+
+	size_t cId = mCount++;
+	mPositions[cId] = pParticle.PPosition;
+	mPrevPositions[cId] = pParticle.PPosition;
+	mVelocities[cId] = pParticle.PVelocity;
+	mColors[cId] = pParticle.PColor;
+	mStartColors[cId] = pParticle.getStartColor();
+	mEndColors[cId] = pParticle.getEndColor();
+	mAges[cId] = pParticle.getAge();
+	mLives[cId] = pParticle.getLife();
+	return true;
+}
+
+// Draws every random field for the whole batch with one bulk fill each
+// (velocities as unit values scaled per axis afterwards), then builds the
+// colors in a single pass
+size_t DS4ParticleSystem::emit(const Vec3f *pPositions, size_t pCount, const DS4EmitParams &pParams)
+{
+	DS4_TRACE_SCOPE("particles.emit");
+	size_t cCount = mCount < mLimit ? math<size_t>::min(pCount, mLimit - mCount) : 0;
+	if (cCount == 0)
+		return 0;
+
+	size_t cBase = mCount;
+	memcpy(&mPositions[cBase], pPositions, cCount*sizeof(Vec3f));
+	memcpy(&mPrevPositions[cBase], pPositions, cCount*sizeof(Vec3f));
+	mRandom.fillFloats(&mVelocities[cBase].x, cCount * 3, 0.0f, 1.0f);
+	mRandom.fillFloats(&mAges[cBase], cCount, pParams.LifeRange.x, pParams.LifeRange.y);
+	memcpy(&mLives[cBase], &mAges[cBase], cCount*sizeof(float));
+	mRandom.fillFloats(&mEmitAlphas[0], cCount, 0.1f, pParams.AlphaMax);
+	bool cSomeMica = pParams.MicaRatio > 0.0f && pParams.MicaRatio < 1.0f;
+	if (cSomeMica)
+		mRandom.fillFloats(&mEmitMica[0], cCount, 0.0f, 1.0f);
+
+	const Vec3f &cVelMin = pParams.VelocityMin;
+	Vec3f cVelRange = pParams.VelocityMax - pParams.VelocityMin;
+	for (size_t ei = 0; ei < cCount; ++ei)
+	{
+		size_t cId = cBase + ei;
+		Vec3f &cVel = mVelocities[cId];
+		cVel = Vec3f(cVelMin.x + cVelRange.x*cVel.x, cVelMin.y + cVelRange.y*cVel.y, cVelMin.z + cVelRange.z*cVel.z);
+
+		bool cIsMica = cSomeMica ? mEmitMica[ei] < pParams.MicaRatio : pParams.MicaRatio >= 1.0f;
+		getParticleColors(mEmitAlphas[ei], cIsMica, mStartColors[cId], mEndColors[cId]);
+		mColors[cId] = mStartColors[cId];
+	}
+	mCount += cCount;
+	return cCount;
 }
 #pragma endregion DS4ParticleSystem
 
@@ -0,0 +1,300 @@
+#include <cstring>
+#include <vector>
+#include "DS4ParticleKernels.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define DS4_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DS4_TARGET_AVX2
+#else
+#define DS4_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+#pragma region Scalar
+static void stepAgesScalar(float *pAges, float pDt, size_t pBegin, size_t pEnd)
+{
+	for (size_t pi = pBegin; pi < pEnd; ++pi)
+		pAges[pi] -= pDt;
+}
+
+// A particle whose age ran out this step keeps its position and velocity,
+// it is drawn where it stopped until the next step retires it
+static void integrateScalar(const DS4ParticleArrays &pArrays, float pDt, float pDamping, size_t pBegin, size_t pEnd)
+{
+	for (size_t fi = pBegin; fi < pEnd; ++fi)
+	{
+		float cVel = pArrays.Velocities[fi];
+		pArrays.PrevPositions[fi] = pArrays.Positions[fi];
+		if (pArrays.Ages[fi / 3] > 0.0f)
+		{
+			pArrays.Positions[fi] += cVel * pDt;
+			pArrays.Velocities[fi] = cVel * pDamping;
+		}
+	}
+}
+
+// Same result as _mm_max_ps(pLife, 0): expired particles get the end color
+static inline float clampLife(float pLife)
+{
+	return pLife > 0.0f ? pLife : 0.0f;
+}
+
+static void lerpColorsScalar(const DS4ParticleArrays &pArrays, size_t pBegin, size_t pEnd)
+{
+	for (size_t pi = pBegin; pi < pEnd; ++pi)
+	{
+		float cLife = clampLife(pArrays.Ages[pi] / pArrays.Lives[pi]);
+		const float *cStart = pArrays.StartColors + pi * 4;
+		const float *cEnd = pArrays.EndColors + pi * 4;
+		float *cColor = pArrays.Colors + pi * 4;
+		for (int ci = 0; ci < 4; ++ci)
+			cColor[ci] = cEnd[ci] + (cStart[ci] - cEnd[ci]) * cLife;
+	}
+}
+
+static void stepScalar(const DS4ParticleArrays &pArrays, size_t pBegin, size_t pEnd, float pDt, float pDamping)
+{
+	stepAgesScalar(pArrays.Ages, pDt, pBegin, pEnd);
+	integrateScalar(pArrays, pDt, pDamping, pBegin * 3, pEnd * 3);
+	lerpColorsScalar(pArrays, pBegin, pEnd);
+}
+#pragma endregion Scalar
+
+#ifdef DS4_KERNELS_X86
+#pragma region SSE2
+static void stepSSE2(const DS4ParticleArrays &pArrays, size_t pBegin, size_t pEnd, float pDt, float pDamping)
+{
+	size_t pi = pBegin;
+	const __m128 cDt = _mm_set1_ps(pDt);
+	for (; pi + 4 <= pEnd; pi += 4)
+		_mm_storeu_ps(pArrays.Ages + pi, _mm_sub_ps(_mm_loadu_ps(pArrays.Ages + pi), cDt));
+	stepAgesScalar(pArrays.Ages, pDt, pi, pEnd);
+
+	//Four particles fill three registers of xyz floats. Each register gets
+	//its lanes' live masks spread from the four age compares, and expired
+	//lanes keep their old position and velocity.
+	const __m128 cZero = _mm_setzero_ps();
+	const __m128 cDamping = _mm_set1_ps(pDamping);
+	pi = pBegin;
+	for (; pi + 4 <= pEnd; pi += 4)
+	{
+		__m128 cLive = _mm_cmpgt_ps(_mm_loadu_ps(pArrays.Ages + pi), cZero);
+		__m128 cLiveLanes[3] = {
+			_mm_shuffle_ps(cLive, cLive, _MM_SHUFFLE(1, 0, 0, 0)),
+			_mm_shuffle_ps(cLive, cLive, _MM_SHUFFLE(2, 2, 1, 1)),
+			_mm_shuffle_ps(cLive, cLive, _MM_SHUFFLE(3, 3, 3, 2))
+		};
+		for (int ri = 0; ri < 3; ++ri)
+		{
+			size_t fi = pi * 3 + ri * 4;
+			__m128 cVel = _mm_loadu_ps(pArrays.Velocities + fi);
+			__m128 cPos = _mm_loadu_ps(pArrays.Positions + fi);
+			__m128 cNewPos = _mm_add_ps(cPos, _mm_mul_ps(cVel, cDt));
+			__m128 cNewVel = _mm_mul_ps(cVel, cDamping);
+			_mm_storeu_ps(pArrays.PrevPositions + fi, cPos);
+			_mm_storeu_ps(pArrays.Positions + fi, _mm_or_ps(_mm_and_ps(cLiveLanes[ri], cNewPos), _mm_andnot_ps(cLiveLanes[ri], cPos)));
+			_mm_storeu_ps(pArrays.Velocities + fi, _mm_or_ps(_mm_and_ps(cLiveLanes[ri], cNewVel), _mm_andnot_ps(cLiveLanes[ri], cVel)));
+		}
+	}
+	integrateScalar(pArrays, pDt, pDamping, pi * 3, pEnd * 3);
+
+	//One rgba color per register, life fractions computed four at a time
+	pi = pBegin;
+	for (; pi + 4 <= pEnd; pi += 4)
+	{
+		__m128 cLife = _mm_max_ps(_mm_div_ps(_mm_loadu_ps(pArrays.Ages + pi), _mm_loadu_ps(pArrays.Lives + pi)), cZero);
+		__m128 cLifeSplat[4] = {
+			_mm_shuffle_ps(cLife, cLife, _MM_SHUFFLE(0, 0, 0, 0)),
+			_mm_shuffle_ps(cLife, cLife, _MM_SHUFFLE(1, 1, 1, 1)),
+			_mm_shuffle_ps(cLife, cLife, _MM_SHUFFLE(2, 2, 2, 2)),
+			_mm_shuffle_ps(cLife, cLife, _MM_SHUFFLE(3, 3, 3, 3))
+		};
+		for (int li = 0; li < 4; ++li)
+		{
+			size_t ci = (pi + li) * 4;
+			__m128 cStart = _mm_loadu_ps(pArrays.StartColors + ci);
+			__m128 cEnd = _mm_loadu_ps(pArrays.EndColors + ci);
+			__m128 cColor = _mm_add_ps(cEnd, _mm_mul_ps(_mm_sub_ps(cStart, cEnd), cLifeSplat[li]));
+			_mm_storeu_ps(pArrays.Colors + ci, cColor);
+		}
+	}
+	lerpColorsScalar(pArrays, pi, pEnd);
+}
+#pragma endregion SSE2
+
+#pragma region AVX2
+DS4_TARGET_AVX2 static void stepAVX2(const DS4ParticleArrays &pArrays, size_t pBegin, size_t pEnd, float pDt, float pDamping)
+{
+	size_t pi = pBegin;
+	const __m256 cDt = _mm256_set1_ps(pDt);
+	for (; pi + 8 <= pEnd; pi += 8)
+		_mm256_storeu_ps(pArrays.Ages + pi, _mm256_sub_ps(_mm256_loadu_ps(pArrays.Ages + pi), cDt));
+	stepAgesScalar(pArrays.Ages, pDt, pi, pEnd);
+
+	//Eight particles fill three registers of xyz floats, the live masks are
+	//permuted out to the lanes of each one as in the SSE2 kernel
+	const __m256 cZero = _mm256_setzero_ps();
+	const __m256 cDamping = _mm256_set1_ps(pDamping);
+	const __m256i cLaneOwners[3] = {
+		_mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+		_mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+		_mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7)
+	};
+	pi = pBegin;
+	for (; pi + 8 <= pEnd; pi += 8)
+	{
+		__m256 cLive = _mm256_cmp_ps(_mm256_loadu_ps(pArrays.Ages + pi), cZero, _CMP_GT_OQ);
+		for (int ri = 0; ri < 3; ++ri)
+		{
+			size_t fi = pi * 3 + ri * 8;
+			__m256 cLiveLanes = _mm256_permutevar8x32_ps(cLive, cLaneOwners[ri]);
+			__m256 cVel = _mm256_loadu_ps(pArrays.Velocities + fi);
+			__m256 cPos = _mm256_loadu_ps(pArrays.Positions + fi);
+			_mm256_storeu_ps(pArrays.PrevPositions + fi, cPos);
+			_mm256_storeu_ps(pArrays.Positions + fi, _mm256_blendv_ps(cPos, _mm256_add_ps(cPos, _mm256_mul_ps(cVel, cDt)), cLiveLanes));
+			_mm256_storeu_ps(pArrays.Velocities + fi, _mm256_blendv_ps(cVel, _mm256_mul_ps(cVel, cDamping), cLiveLanes));
+		}
+	}
+	integrateScalar(pArrays, pDt, pDamping, pi * 3, pEnd * 3);
+
+	//Two rgba colors per register, life fractions computed eight at a time
+	pi = pBegin;
+	for (; pi + 8 <= pEnd; pi += 8)
+	{
+		float cLife[8];
+		_mm256_storeu_ps(cLife, _mm256_max_ps(_mm256_div_ps(_mm256_loadu_ps(pArrays.Ages + pi), _mm256_loadu_ps(pArrays.Lives + pi)), cZero));
+		for (int li = 0; li < 8; li += 2)
+		{
+			size_t ci = (pi + li) * 4;
+			__m256 cLifePair = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(cLife[li])), _mm_set1_ps(cLife[li + 1]), 1);
+			__m256 cStart = _mm256_loadu_ps(pArrays.StartColors + ci);
+			__m256 cEnd = _mm256_loadu_ps(pArrays.EndColors + ci);
+			__m256 cColor = _mm256_add_ps(cEnd, _mm256_mul_ps(_mm256_sub_ps(cStart, cEnd), cLifePair));
+			_mm256_storeu_ps(pArrays.Colors + ci, cColor);
+		}
+	}
+	lerpColorsScalar(pArrays, pi, pEnd);
+}
+#pragma endregion AVX2
+
+static bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int cInfo[4];
+	__cpuid(cInfo, 0);
+	if (cInfo[0] < 7)
+		return false;
+
+	//AVX state has to be enabled by the OS as well as supported by the cpu
+	__cpuid(cInfo, 1);
+	bool cOSXSave = (cInfo[2] & (1 << 27)) != 0;
+	bool cAVX = (cInfo[2] & (1 << 28)) != 0;
+	if (!cOSXSave || !cAVX)
+		return false;
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(cInfo, 7, 0);
+	return (cInfo[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+DS4KernelLevel DS4GetBestKernelLevel()
+{
+#ifdef DS4_KERNELS_X86
+	static const DS4KernelLevel sLevel = cpuHasAVX2() ? KERNEL_AVX2 : KERNEL_SSE2;
+	return sLevel;
+#else
+	return KERNEL_SCALAR;
+#endif
+}
+
+DS4StepKernel DS4GetStepKernel(DS4KernelLevel pLevel)
+{
+#ifdef DS4_KERNELS_X86
+	if (pLevel > DS4GetBestKernelLevel())
+		pLevel = DS4GetBestKernelLevel();
+	if (pLevel == KERNEL_AVX2)
+		return stepAVX2;
+	if (pLevel == KERNEL_SSE2)
+		return stepSSE2;
+#endif
+	return stepScalar;
+}
+
+const char* DS4GetKernelName(DS4KernelLevel pLevel)
+{
+	switch (pLevel)
+	{
+	case KERNEL_AVX2:
+		return "AVX2";
+	case KERNEL_SSE2:
+		return "SSE2";
+	default:
+		return "Scalar";
+	}
+}
+
+bool DS4VerifyStepKernel(DS4KernelLevel pLevel, size_t pCount)
+{
+	//Odd sizes exercise the scalar tails of the vector loops
+	vector<float> cPos(pCount * 3), cPrev(pCount * 3), cVel(pCount * 3), cColor(pCount * 4), cStart(pCount * 4), cEnd(pCount * 4);
+	vector<float> cAges(pCount), cLives(pCount);
+	unsigned int cSeed = 0x9e3779b9u;
+	for (size_t pi = 0; pi < pCount; ++pi)
+	{
+		for (int vi = 0; vi < 3; ++vi)
+		{
+			cSeed = cSeed * 1664525u + 1013904223u;
+			cPos[pi * 3 + vi] = static_cast<float>(cSeed >> 8) / 8192.0f - 1024.0f;
+			cSeed = cSeed * 1664525u + 1013904223u;
+			cVel[pi * 3 + vi] = static_cast<float>(cSeed >> 8) / 16384.0f - 512.0f;
+		}
+		for (int ci = 0; ci < 4; ++ci)
+		{
+			cSeed = cSeed * 1664525u + 1013904223u;
+			cStart[pi * 4 + ci] = static_cast<float>(cSeed >> 8) / 16777216.0f;
+			cSeed = cSeed * 1664525u + 1013904223u;
+			cEnd[pi * 4 + ci] = static_cast<float>(cSeed >> 8) / 16777216.0f;
+		}
+		int cLifeFrames = 30 + static_cast<int>(pi % 571);
+		cLives[pi] = cLifeFrames / 60.0f;
+		cAges[pi] = (1 + static_cast<int>((pi * 7) % cLifeFrames)) / 60.0f;
+		//Every fifth particle runs out halfway through the second step
+		if (pi % 5 == 0)
+			cAges[pi] = 1.5f / 60.0f;
+	}
+
+	vector<float> cRefPos(cPos), cRefPrev(cPrev), cRefVel(cVel), cRefColor(cColor), cRefAges(cAges);
+	DS4ParticleArrays cArrays = { cPos.data(), cPrev.data(), cVel.data(), cColor.data(), cStart.data(), cEnd.data(), cAges.data(), cLives.data() };
+	DS4ParticleArrays cRefArrays = { cRefPos.data(), cRefPrev.data(), cRefVel.data(), cRefColor.data(), cStart.data(), cEnd.data(), cRefAges.data(), cLives.data() };
+
+	DS4StepKernel cKernel = DS4GetStepKernel(pLevel);
+	for (int si = 0; si < 4; ++si)
+	{
+		cKernel(cArrays, 0, pCount, 1.0f / 60.0f, 1.0001f);
+		stepScalar(cRefArrays, 0, pCount, 1.0f / 60.0f, 1.0001f);
+	}
+
+	//Particles that ran out have to stay where they stopped
+	for (size_t pi = 0; pi < pCount; ++pi)
+	{
+		if (cAges[pi] <= 0.0f && memcmp(&cPos[pi * 3], &cPrev[pi * 3], 3 * sizeof(float)) != 0)
+			return false;
+	}
+
+	return memcmp(cAges.data(), cRefAges.data(), cAges.size()*sizeof(float)) == 0 &&
+		memcmp(cPos.data(), cRefPos.data(), cPos.size()*sizeof(float)) == 0 &&
+		memcmp(cPrev.data(), cRefPrev.data(), cPrev.size()*sizeof(float)) == 0 &&
+		memcmp(cVel.data(), cRefVel.data(), cVel.size()*sizeof(float)) == 0 &&
+		memcmp(cColor.data(), cRefColor.data(), cColor.size()*sizeof(float)) == 0;
+}
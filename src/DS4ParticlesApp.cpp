@@ -1,10 +1,12 @@
 #include <boost/filesystem.hpp>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include <fstream>
+#include <iomanip>
 #include <numeric>
+#include <sstream>
 #include "DS4ParticlesApp.h"
-#include "DSAPIUtil.h"
 
 namespace bfs = boost::filesystem;
 
@@ -25,28 +27,94 @@ void DS4ParticlesApp::prepareSettings(Settings *pSettings)
 
 void DS4ParticlesApp::setup()
 {
+	DS4Trace::setThreadName("main");
 	mIsDebug = false;
 	mCamInfo = false;
-	if (!setupDSAPI())
-		console() << "Error Starting DSAPI Session" << endl;
+	mIsSoftRendering = false;
+	mSoftFrame = 0;
 
 	setupScene();
 	setupGUI();
+	if (!setupDepthSource())
+		console() << "Error Starting Depth Source" << endl;
+	mDepthProcessor.setup(S_DEPTH_SIZE, mZIntrinsics);
 	setupColors();
 	setupAudio();
+
+	mWorkerPool = DS4WorkerPoolRef(new DS4WorkerPool());
+	mParticleSystem.setWorkerPool(mWorkerPool);
+	mDepthProcessor.setWorkerPool(mWorkerPool);
+	mSoftRenderer.setWorkerPool(mWorkerPool);
+	if (mPointBackendName == "immediate")
+		mPointBackend = DS4PointBackendRef(new DS4ImmediatePointBackend());
+	else
+		mPointBackend = DS4PointBackendRef(new DS4StreamPointBackend());
+	mFrameResult = make_shared<DS4FrameResult>();
+	if (mPipelineCV)
+		mCVPipeline.start(&mDepthProcessor);
+	mParticleSystem.setCapacity(mNumParticles);
+	uint32_t cSeed = mRandomSeed != 0 ? mRandomSeed : (uint32_t)time(nullptr);
+	mParticleSystem.setSeed(cSeed);
+	console() << "Random seed: " << cSeed << endl;
+	mSimClock.setRate(mSimRate);
+	mLastUpdateTime = getElapsedSeconds();
+	DS4GovernorParams cGovernor = { mGovernorTarget, { mGovernorCloudResMax, mGovernorSpawnResMax, mGovernorBoltResMax, mGovernorParticlesMin, mGovernorSpawnRateMax } };
+	mGovernor.setup(cGovernor);
+	mFrameCpuMs = 0;
+	DS4KernelLevel cKernel = mParticleSystem.getKernelLevel();
+	if (!DS4VerifyStepKernel(cKernel, 1031))
+	{
+		console() << DS4GetKernelName(cKernel) << " particle kernel does not match the scalar path, falling back" << endl;
+		mParticleSystem.setKernelLevel(KERNEL_SCALAR);
+	}
+	console() << "Particle kernel: " << DS4GetKernelName(mParticleSystem.getKernelLevel()) << ", " << mWorkerPool->getThreadCount() << " threads" << endl;
+	console() << "Point backend: " << mPointBackend->getName() << endl;
+	console() << "Sim rate: " << mSimClock.getRate() << " Hz" << endl;
 }
 
 void DS4ParticlesApp::update()
 {
-	if (mDSAPI->isZEnabled())
+	DS4_TRACE_SCOPE("update");
+	updateGovernor();
+	//The pool stays at the GUI's Particle Count, the governor only lowers the
+	//live limit so stepping quality down never cuts particles off
+	if (mParticleSystem.capacity() != (size_t)mNumParticles)
+		mParticleSystem.setCapacity((size_t)mNumParticles);
+	mParticleSystem.setLimit((size_t)mQuality.ParticleCount);
+
+	double cNow = getElapsedSeconds();
+	double cElapsed = cNow - mLastUpdateTime;
+	mLastUpdateTime = cNow;
+
+	bool cGrabbed = false;
+	if (mDepthSource->isZEnabled())
 	{
-		if (mDSAPI->grab())
 		{
-			mDepthBuffer = mDSAPI->getZImage();
+			DS4_TRACE_SCOPE("update.grab");
+			cGrabbed = mDepthSource->grab();
+		}
+		if (cGrabbed)
+		{
+			mDepthBuffer = mDepthSource->getZImage();
+			if (mRecorder.isRecording())
+				mRecorder.push(mDepthBuffer, mDepthSource->getFrameTime(), mDepthSource->getFrameNumber());
 			updateAudio();
+			Timer cTimer(true);
 			updateCV();
+			mFrameCpuMs += cTimer.getSeconds()*1000.0;
 		}
 	}
+
+	//A replay running flat out counts each frame as 1/60 s, so the
+	//simulation repeats exactly however fast the frames are processed
+	if (mDepthSourceName == "replay" && !mReplayRealtime)
+		cElapsed = cGrabbed ? 1.0 / 60.0 : 0.0;
+	if (!mIsDebug)
+	{
+		Timer cTimer(true);
+		stepSimulation(cElapsed);
+		mFrameCpuMs += cTimer.getSeconds()*1000.0;
+	}
 	mFPS = getAverageFps();
 }
 
@@ -78,6 +146,31 @@ void DS4ParticlesApp::keyDown(KeyEvent pEvent)
 	case 'l':
 		mDrawLogo = !mDrawLogo;
 		break;
+	case 'k':
+	{
+		//Stress test: retire half the pool in a single step
+		mParticleSystem.expire(mParticleSystem.count() / 2);
+		Timer cTimer(true);
+		mParticleSystem.step(mSimClock.getStepSeconds());
+		cTimer.stop();
+		console() << "Expired half the pool in " << cTimer.getSeconds()*1000.0 << " ms, " << mParticleSystem.count() << " particles left" << endl;
+		break;
+	}
+	case 'p':
+		reportStepScaling();
+		break;
+	case 'r':
+		toggleRecording();
+		break;
+	case 't':
+		dumpTrace();
+		break;
+	case 'o':
+		mIsSoftRendering = !mIsSoftRendering;
+		if (mIsSoftRendering)
+			mSoftFrame = 0;
+		console() << (mIsSoftRendering ? "Soft rendering to " + mRenderPath : "Soft rendering stopped after " + to_string(mSoftFrame) + " frames") << endl;
+		break;
 	case 'c':
 	{
 		int cColorMode = static_cast<int>(mColorMode);
@@ -135,69 +228,47 @@ void DS4ParticlesApp::mouseDrag(MouseEvent pEvent)
 
 void DS4ParticlesApp::draw()
 {
+	Timer cTimer(true);
 	if (mIsDebug)
 		drawDebug();
 	else
 		drawRunning();
+	mFrameCpuMs += cTimer.getSeconds()*1000.0;
+
+	if (mIsSoftRendering)
+		renderSoftFrame();
 }
 #pragma endregion Cinder Loop
 
 #pragma region Setup
-bool DS4ParticlesApp::setupDSAPI()
+bool DS4ParticlesApp::setupDepthSource()
 {
-	bool retVal = true;
-	mDSAPI = DSAPIRef(DSCreate(DS_DS4_PLATFORM), DSDestroy);
-	if (!mDSAPI->probeConfiguration())
+	if (mDepthSourceName == "replay")
 	{
-		retVal = false;
-		console() << "Unable to get DS hardware config" << endl;
+		auto cSpeed = mReplayRealtime ? DS4ReplaySource::SPEED_REALTIME : DS4ReplaySource::SPEED_MAX;
+		mDepthSource = DS4DepthSourceRef(new DS4ReplaySource(mReplayPath, cSpeed, mReplayLoop));
 	}
-	if (!mDSAPI->isCalibrationValid())
-	{
-		retVal = false;
-		console() << "Calibration is invalid" << endl;
-	}
-	if (!mDSAPI->enableLeft(true))
-	{
-		retVal = false;
-		console() << "Unable to start left stream" << endl;
-	}
-	if (!mDSAPI->enableRight(true))
-	{
-		retVal = false;
-		console() << "Unable to start right stream" << endl;
-	}
-	if (!mDSAPI->enableZ(true))
-	{
-		retVal = false;
-		console() << "Unable to start depth stream" << endl;
-	}
-	if (!mDSAPI->setLRZResolutionMode(true, S_DEPTH_SIZE.x, S_DEPTH_SIZE.y, 60, DS_LUMINANCE8))
-	{
-		retVal = false;
-		console() << "Unable to set requested depth resolution" << endl;
-	}
-	if(!mDSAPI->getCalibIntrinsicsZ(mZIntrinsics))
-	{
-		retVal = false;
-		console() << "Unable to set get depth intrinsics" << endl;
-	}
-	if (!mDSAPI->startCapture())
+	else
+		mDepthSource = DS4DepthSourceRef(new DS4DSAPISource(S_DEPTH_SIZE, 60));
+
+	//A max speed replay should hand over every frame, so it stays inline
+	if (mCaptureThread && (mDepthSourceName != "replay" || mReplayRealtime))
+		mDepthSource = DS4DepthSourceRef(new DS4CaptureThread(mDepthSource));
+
+	console() << "Depth source: " << mDepthSource->getName() << endl;
+	if (!mDepthSource->startCapture())
+		return false;
+	if (mDepthSource->getZSize() != S_DEPTH_SIZE)
 	{
-		retVal = false;
-		console() << "Unable to start ds4" << endl;
+		console() << "Depth source is " << mDepthSource->getZSize() << ", expected " << S_DEPTH_SIZE << endl;
+		mDepthSource->stopCapture();
+		return false;
 	}
-
-	return retVal;
+	return mDepthSource->getCalibIntrinsicsZ(mZIntrinsics);
 }
 
 void DS4ParticlesApp::setupScene()
 {
-	mDepthPixels = new uint8_t[S_DEPTH_SIZE.x*S_DEPTH_SIZE.y]{0};
-	mPrevDepthBuffer = new uint16_t[S_DEPTH_SIZE.x*S_DEPTH_SIZE.y];
-	//mMatCurrent = cv::Mat::zeros(S_DEPTH_SIZE.y, S_DEPTH_SIZE.x, CV_8U(1));
-	mMatPrev = cv::Mat::zeros(S_DEPTH_SIZE.y, S_DEPTH_SIZE.x, CV_8U(1));
-
 	mCamera.setPerspective(45.0f, getWindowAspectRatio(), 100, 4000);
 	mCamera.setFovHorizontal(35.0f);
 	mCamera.setEyePoint(Vec3f(0, 606.351, -757.588));
@@ -226,7 +297,13 @@ void DS4ParticlesApp::setupGUI()
 		mDepthMax = 2000;
 		mThresh = 128;
 		mSizeMin = 250;
+		mDenoise = false;
+		mDenoiseAlpha = 0.5f;
+		mDenoiseSnap = 50;
+		mDenoiseHoleFrames = 3;
 
+		mCloudMode = CLOUD_MODE_STRIDE;
+		mVoxelSize = 15.0f;		//Voxel edge in mm
 		mCloudRes = 2; //Cloud Resolution
 		mSpawnRes = 4; //Spawn Resolution
 		mBoltRes = 2;  //Bolt Resolution
@@ -235,8 +312,9 @@ void DS4ParticlesApp::setupGUI()
 
 		mNumParticles = 5000;
 		mParticleSize = 2.0f;	//Particle Size
-		mAgeMin = 30;			//Min Particle Age
-		mAgeMax = 120;			//Max Particle Age
+		mLifeMin = 0.5f;		//Min Particle Life, seconds
+		mLifeMax = 2.0f;		//Max Particle Life, seconds
+		mSimRate = 60.0f;		//Simulation steps per second
 		mFramesSpawn = 5;
 		mSpawnLevel = 0.15f;
 		mBoltWidthMin = 0.1f;
@@ -249,16 +327,51 @@ void DS4ParticlesApp::setupGUI()
 		mDrawBackground = false;
 		mBGAlpha = 0.5f;
 		mColorMode = COLOR_MODE_BLUE;
+		mDepthSourceName = "camera";
+		mReplayPath = "";
+		mReplayRealtime = true;
+		mReplayLoop = true;
+		mRecordPath = "recordings";
+		mCaptureThread = true;
+		mPipelineCV = false;
+		mAudioFile = "";
+		mAudioBands = "0,150,400,1000,2500,6000,20000";
+		mOnsetThreshold = 1.5f;
+		mTracePath = "traces";
+		mTraceOnExit = false;
+		mRenderPath = "renders";
+		mPointBackendName = "stream";
+		mRandomSeed = 0;
+		mGovernorOn = false;
+		mGovernorTarget = 12.0f;	//CPU ms per frame, headroom for the GPU at 60 fps
+		mGovernorCloudResMax = 8;
+		mGovernorSpawnResMax = 8;
+		mGovernorBoltResMax = 4;
+		mGovernorParticlesMin = 1000;
+		mGovernorSpawnRateMax = 6;
 	}
+	mQuality.CloudRes = mCloudRes;
+	mQuality.SpawnRes = mSpawnRes;
+	mQuality.BoltRes = 1;
+	mQuality.ParticleCount = mNumParticles;
+	mQuality.FramesSpawn = mFramesSpawn;
+	mQualityLevel = 0;
+	mGovernorMs = 0;
 	mGUI = params::InterfaceGl::create("Config", Vec2i(250, 320));
 	mGUI->addText("Depth Params");
 	mGUI->addParam("Min Depth", &mDepthMin,"min=0 max=1000 step=10");
 	mGUI->addParam("Max Depth", &mDepthMax, "min=1500 max=5000 step=10");
 	mGUI->addParam("Threshold", &mThresh, "min=0 max=255 step=1");
 	mGUI->addParam("Min Poly Area", &mSizeMin, "min=0 step=0.1");
+	mGUI->addParam("Denoise", &mDenoise);
+	mGUI->addParam("Denoise Alpha", &mDenoiseAlpha, "min=0 max=1 step=0.05");
+	mGUI->addParam("Denoise Snap", &mDenoiseSnap, "min=0 max=500 step=5");
+	mGUI->addParam("Denoise Hole Frames", &mDenoiseHoleFrames, "min=0 max=30 step=1");
 	mGUI->addSeparator();
 	mGUI->addText("Point Cloud Params");
+	mGUI->addParam("Cloud Mode", { "Stride", "Voxel" }, &mCloudMode);
 	mGUI->addParam("Cloud Res", &mCloudRes, "min=1 max=8 step=1");
+	mGUI->addParam("Voxel Size", &mVoxelSize, "min=2 max=100 step=1");
 	mGUI->addParam("Bolt Res", &mBoltRes, "min=1 max=8 step=1");
 	mGUI->addParam("Spawner Res", &mSpawnRes, "min=1 max=8 step=1");
 	mGUI->addParam("Point Size", &mPointSize, "min=0.1 max=10 step=0.1");
@@ -268,14 +381,26 @@ void DS4ParticlesApp::setupGUI()
 	mGUI->addParam("Max Bolt Brightness", &mBoltAlphaMax, "min=0.05 max=1.0 step=0.01");
 	mGUI->addSeparator();
 	mGUI->addText("Particle Params");
-	mGUI->addParam("Particle Count", &mNumParticles, "min=0 max=40000 step=100");
+	mGUI->addParam("Particle Count", &mNumParticles, "min=0 max=200000 step=100");
 	mGUI->addParam("Particle Size", &mParticleSize, "min=0.1 max=10 step=0.1");
 	mGUI->addParam("Particle Brightness", &mParticleAlpha, "min=0.01 max=1 step=0.01");
-	mGUI->addParam("Min Age", &mAgeMin, "min=0 max=150 step=1");
-	mGUI->addParam("Max Age", &mAgeMax, "min=60 max=600 step=15");
+	mGUI->addParam("Min Life", &mLifeMin, "min=0 max=2.5 step=0.05");
+	mGUI->addParam("Max Life", &mLifeMax, "min=1 max=10 step=0.25");
+	mGUI->addParam("Sim Rate", &mSimRate, "min=10 max=240 step=5");
 	mGUI->addParam("Spawn Rate", &mFramesSpawn, "min=1 max=10 step=1");
 	mGUI->addParam("Spawn Level", &mSpawnLevel, "min=0 max=1 step=0.01");
 	mGUI->addSeparator();
+	mGUI->addText("Quality Governor");
+	mGUI->addParam("Governor", &mGovernorOn);
+	mGUI->addParam("Target CPU ms", &mGovernorTarget, "min=2 max=33 step=0.5");
+	mGUI->addParam("Quality Level", &mQualityLevel, "", true);
+	mGUI->addParam("CPU ms", &mGovernorMs, "", true);
+	mGUI->addParam("Live Cloud Res", &mQuality.CloudRes, "", true);
+	mGUI->addParam("Live Spawner Res", &mQuality.SpawnRes, "", true);
+	mGUI->addParam("Live Bolt Res", &mQuality.BoltRes, "", true);
+	mGUI->addParam("Live Particle Count", &mQuality.ParticleCount, "", true);
+	mGUI->addParam("Live Spawn Rate", &mQuality.FramesSpawn, "", true);
+	mGUI->addSeparator();
 	mGUI->addText("Logo / Background Params");
 	mGUI->addParam("Show Logo", &mDrawLogo);
 	mGUI->addParam("Logo Size", &mLogoSize, "min=64 max=512 step=4");
@@ -290,17 +415,50 @@ void DS4ParticlesApp::setupGUI()
 
 void DS4ParticlesApp::setupAudio()
 {
+	mMagMean = 0;
+	mAudioFeatures = DS4AudioFeatures();
+
+	DS4AudioSettings cSettings;
+	cSettings.FftSize = 2048;
+	cSettings.WindowSize = 1024;
+	cSettings.OnsetThreshold = mOnsetThreshold;
+	stringstream cBands(mAudioBands);
+	string cEdge;
+	while (getline(cBands, cEdge, ','))
+	{
+		//A bad edge is skipped, fewer than two left falls back to the defaults
+		try
+		{
+			cSettings.BandEdges.push_back(stof(cEdge));
+		}
+		catch (logic_error&)
+		{
+			console() << "Ignoring audio_bands edge \"" << cEdge << "\"" << endl;
+		}
+	}
+
+	if (!mAudioFile.empty())
+	{
+		float cRate;
+		if (DS4LoadWav(mAudioFile, mAudioFileSamples, cRate) && !mAudioFileSamples.empty())
+		{
+			mFileAnalyzer.setup(cRate, cSettings);
+			mAudioFileFed = 0;
+			mAudioFileTimer.start();
+			console() << "Audio input: " << mAudioFile << endl;
+			return;
+		}
+		mAudioFileSamples.clear();
+		console() << "Unable to read " << mAudioFile << ", using the audio input device" << endl;
+	}
+
 	auto cAudioCtx = audio::Context::master();
 	mInputDeviceNode = cAudioCtx->createInputDeviceNode();
+	mAudioNode = cAudioCtx->makeNode(new DS4AudioAnalyzerNode(cSettings, audio::Node::Format().channels(1)));
 
-	auto cMonitorFormat = audio::MonitorSpectralNode::Format().fftSize(2048).windowSize(1024);
-	mMonitorSpectralNode = cAudioCtx->makeNode(new audio::MonitorSpectralNode(cMonitorFormat));
-
-	mInputDeviceNode >> mMonitorSpectralNode;
+	mInputDeviceNode >> mAudioNode;
 	mInputDeviceNode->enable();
 	cAudioCtx->enable();
-
-	mMagMean = 0;
 }
 void DS4ParticlesApp::setupColors()
 {
@@ -324,6 +482,12 @@ void DS4ParticlesApp::readConfig()
 		("max_depth", bpo::value<int>(), "Max Depth")
 		("threshold", bpo::value<double>(), "Threshold")
 		("min_poly_area", bpo::value<double>(), "Min Poly Area")
+		("denoise", bpo::value<bool>(), "Temporal Denoise")
+		("denoise_alpha", bpo::value<float>(), "Denoise Alpha")
+		("denoise_snap", bpo::value<int>(), "Denoise Snap Distance")
+		("denoise_hole_frames", bpo::value<int>(), "Denoise Hole Frames")
+		("cloud_mode", bpo::value<int>(), "Cloud Mode")
+		("voxel_size", bpo::value<float>(), "Voxel Size")
 		("cloud_res", bpo::value<int>(), "Cloud Res")
 		("bolt_res", bpo::value<int>(), "Bolt Res")
 		("spawner_res", bpo::value<int>(), "Spawner Res")
@@ -335,8 +499,11 @@ void DS4ParticlesApp::readConfig()
 		("particle_count", bpo::value<int>(), "Particle Count")
 		("particle_size", bpo::value<float>(), "Particle Size")
 		("particle_alpha", bpo::value<float>(), "Particle Alpha")
-		("min_age", bpo::value<int>(), "Min Age")
-		("max_age", bpo::value<int>(), "Max Age")
+		("min_life", bpo::value<float>(), "Min Life In Seconds")
+		("max_life", bpo::value<float>(), "Max Life In Seconds")
+		("min_age", bpo::value<int>(), "Min Age In Frames (old)")
+		("max_age", bpo::value<int>(), "Max Age In Frames (old)")
+		("sim_rate", bpo::value<float>(), "Simulation Rate")
 		("spawn_rate", bpo::value<int>(), "Spawn Rate")
 		("spawn_level", bpo::value<float>(), "Spawn Level")
 		("draw_logo", bpo::value<bool>(), "Draw Logo")
@@ -345,6 +512,28 @@ void DS4ParticlesApp::readConfig()
 		("draw_bg", bpo::value<bool>(), "Draw Background")
 		("bg_alpha", bpo::value<float>(), "Background Brightness")
 		("color_mode", bpo::value<int>(), "Color Mode")
+		("depth_source", bpo::value<string>(), "Depth Source")
+		("replay_path", bpo::value<string>(), "Replay Path")
+		("replay_realtime", bpo::value<bool>(), "Replay In Real Time")
+		("replay_loop", bpo::value<bool>(), "Loop Replay")
+		("record_path", bpo::value<string>(), "Recording Directory")
+		("capture_thread", bpo::value<bool>(), "Capture On A Separate Thread")
+		("pipeline_cv", bpo::value<bool>(), "Process Depth One Frame Ahead")
+		("audio_file", bpo::value<string>(), "WAV File To Analyze Instead Of The Input Device")
+		("audio_bands", bpo::value<string>(), "Audio Band Edges In Hz")
+		("onset_threshold", bpo::value<float>(), "Onset Threshold")
+		("trace_path", bpo::value<string>(), "Trace Directory")
+		("trace_on_exit", bpo::value<bool>(), "Write Trace On Exit")
+		("render_path", bpo::value<string>(), "Soft Render Directory")
+		("point_backend", bpo::value<string>(), "Point Drawing Path")
+		("random_seed", bpo::value<uint32_t>(), "Particle Random Seed")
+		("governor", bpo::value<bool>(), "Quality Governor")
+		("governor_target_ms", bpo::value<float>(), "Governor CPU Time Target")
+		("governor_cloud_res_max", bpo::value<int>(), "Governor Max Cloud Res")
+		("governor_spawner_res_max", bpo::value<int>(), "Governor Max Spawner Res")
+		("governor_bolt_res_max", bpo::value<int>(), "Governor Max Bolt Res")
+		("governor_particles_min", bpo::value<int>(), "Governor Min Particle Count")
+		("governor_spawn_rate_max", bpo::value<int>(), "Governor Max Spawn Rate")
 	;
 
 	try
@@ -368,6 +557,30 @@ void DS4ParticlesApp::readConfig()
 			mSizeMin = cConfigVars["min_poly_area"].as<double>();
 		else
 			mSizeMin = 250;
+		if (cConfigVars.count("denoise"))
+			mDenoise = cConfigVars["denoise"].as<bool>();
+		else
+			mDenoise = false;
+		if (cConfigVars.count("denoise_alpha"))
+			mDenoiseAlpha = cConfigVars["denoise_alpha"].as<float>();
+		else
+			mDenoiseAlpha = 0.5f;
+		if (cConfigVars.count("denoise_snap"))
+			mDenoiseSnap = cConfigVars["denoise_snap"].as<int>();
+		else
+			mDenoiseSnap = 50;
+		if (cConfigVars.count("denoise_hole_frames"))
+			mDenoiseHoleFrames = cConfigVars["denoise_hole_frames"].as<int>();
+		else
+			mDenoiseHoleFrames = 3;
+		if (cConfigVars.count("cloud_mode"))
+			mCloudMode = cConfigVars["cloud_mode"].as<int>();
+		else
+			mCloudMode = CLOUD_MODE_STRIDE;
+		if (cConfigVars.count("voxel_size"))
+			mVoxelSize = cConfigVars["voxel_size"].as<float>();
+		else
+			mVoxelSize = 15.0f;
 		if (cConfigVars.count("cloud_res"))
 			mCloudRes = cConfigVars["cloud_res"].as<int>();
 		else
@@ -412,14 +625,23 @@ void DS4ParticlesApp::readConfig()
 			mParticleAlpha = cConfigVars["particle_alpha"].as<float>();
 		else
 			mParticleAlpha = 0.15f;
-		if (cConfigVars.count("min_age"))
-			mAgeMin = cConfigVars["min_age"].as<int>();
+		//Older configs give lifetimes in 60 fps frames
+		if (cConfigVars.count("min_life"))
+			mLifeMin = cConfigVars["min_life"].as<float>();
+		else if (cConfigVars.count("min_age"))
+			mLifeMin = cConfigVars["min_age"].as<int>() / 60.0f;
+		else
+			mLifeMin = 0.5f;
+		if (cConfigVars.count("max_life"))
+			mLifeMax = cConfigVars["max_life"].as<float>();
+		else if (cConfigVars.count("max_age"))
+			mLifeMax = cConfigVars["max_age"].as<int>() / 60.0f;
 		else
-			mAgeMin = 30;
-		if (cConfigVars.count("max_age"))
-			mAgeMax = cConfigVars["max_age"].as<int>();
+			mLifeMax = 2.0f;
+		if (cConfigVars.count("sim_rate"))
+			mSimRate = cConfigVars["sim_rate"].as<float>();
 		else
-			mAgeMax = 120;
+			mSimRate = 60.0f;
 		if (cConfigVars.count("spawn_rate"))
 			mFramesSpawn = cConfigVars["spawn_rate"].as<int>();
 		else
@@ -456,6 +678,95 @@ void DS4ParticlesApp::readConfig()
 		}
 		else
 			mColorMode = COLOR_MODE_BLUE;
+
+		if (cConfigVars.count("depth_source"))
+			mDepthSourceName = cConfigVars["depth_source"].as<string>();
+		else
+			mDepthSourceName = "camera";
+		if (cConfigVars.count("replay_path"))
+			mReplayPath = cConfigVars["replay_path"].as<string>();
+		else
+			mReplayPath = "";
+		if (cConfigVars.count("replay_realtime"))
+			mReplayRealtime = cConfigVars["replay_realtime"].as<bool>();
+		else
+			mReplayRealtime = true;
+		if (cConfigVars.count("replay_loop"))
+			mReplayLoop = cConfigVars["replay_loop"].as<bool>();
+		else
+			mReplayLoop = true;
+		if (cConfigVars.count("record_path"))
+			mRecordPath = cConfigVars["record_path"].as<string>();
+		else
+			mRecordPath = "recordings";
+		if (cConfigVars.count("capture_thread"))
+			mCaptureThread = cConfigVars["capture_thread"].as<bool>();
+		else
+			mCaptureThread = true;
+		if (cConfigVars.count("pipeline_cv"))
+			mPipelineCV = cConfigVars["pipeline_cv"].as<bool>();
+		else
+			mPipelineCV = false;
+		if (cConfigVars.count("audio_file"))
+			mAudioFile = cConfigVars["audio_file"].as<string>();
+		else
+			mAudioFile = "";
+		if (cConfigVars.count("audio_bands"))
+			mAudioBands = cConfigVars["audio_bands"].as<string>();
+		else
+			mAudioBands = "0,150,400,1000,2500,6000,20000";
+		if (cConfigVars.count("onset_threshold"))
+			mOnsetThreshold = cConfigVars["onset_threshold"].as<float>();
+		else
+			mOnsetThreshold = 1.5f;
+		if (cConfigVars.count("trace_path"))
+			mTracePath = cConfigVars["trace_path"].as<string>();
+		else
+			mTracePath = "traces";
+		if (cConfigVars.count("trace_on_exit"))
+			mTraceOnExit = cConfigVars["trace_on_exit"].as<bool>();
+		else
+			mTraceOnExit = false;
+		if (cConfigVars.count("render_path"))
+			mRenderPath = cConfigVars["render_path"].as<string>();
+		else
+			mRenderPath = "renders";
+		if (cConfigVars.count("point_backend"))
+			mPointBackendName = cConfigVars["point_backend"].as<string>();
+		else
+			mPointBackendName = "stream";
+		if (cConfigVars.count("random_seed"))
+			mRandomSeed = cConfigVars["random_seed"].as<uint32_t>();
+		else
+			mRandomSeed = 0;
+		if (cConfigVars.count("governor"))
+			mGovernorOn = cConfigVars["governor"].as<bool>();
+		else
+			mGovernorOn = false;
+		if (cConfigVars.count("governor_target_ms"))
+			mGovernorTarget = cConfigVars["governor_target_ms"].as<float>();
+		else
+			mGovernorTarget = 12.0f;
+		if (cConfigVars.count("governor_cloud_res_max"))
+			mGovernorCloudResMax = cConfigVars["governor_cloud_res_max"].as<int>();
+		else
+			mGovernorCloudResMax = 8;
+		if (cConfigVars.count("governor_spawner_res_max"))
+			mGovernorSpawnResMax = cConfigVars["governor_spawner_res_max"].as<int>();
+		else
+			mGovernorSpawnResMax = 8;
+		if (cConfigVars.count("governor_bolt_res_max"))
+			mGovernorBoltResMax = cConfigVars["governor_bolt_res_max"].as<int>();
+		else
+			mGovernorBoltResMax = 4;
+		if (cConfigVars.count("governor_particles_min"))
+			mGovernorParticlesMin = cConfigVars["governor_particles_min"].as<int>();
+		else
+			mGovernorParticlesMin = 1000;
+		if (cConfigVars.count("governor_spawn_rate_max"))
+			mGovernorSpawnRateMax = cConfigVars["governor_spawn_rate_max"].as<int>();
+		else
+			mGovernorSpawnRateMax = 6;
 	}
 	catch (bpo::required_option &e)
 	{
@@ -478,6 +789,12 @@ void DS4ParticlesApp::writeConfig()
 	cOutFile << "max_depth=" << to_string(mDepthMax) << endl;
 	cOutFile << "threshold=" << to_string(mThresh) << endl;
 	cOutFile << "min_poly_area=" << to_string(mSizeMin) << endl;
+	cOutFile << "denoise=" << to_string(mDenoise) << endl;
+	cOutFile << "denoise_alpha=" << to_string(mDenoiseAlpha) << endl;
+	cOutFile << "denoise_snap=" << to_string(mDenoiseSnap) << endl;
+	cOutFile << "denoise_hole_frames=" << to_string(mDenoiseHoleFrames) << endl;
+	cOutFile << "cloud_mode=" << to_string(mCloudMode) << endl;
+	cOutFile << "voxel_size=" << to_string(mVoxelSize) << endl;
 	cOutFile << "cloud_res=" << to_string(mCloudRes) << endl;
 	cOutFile << "bolt_res=" << to_string(mBoltRes) << endl;
 	cOutFile << "spawner_res=" << to_string(mSpawnRes) << endl;
@@ -490,8 +807,9 @@ void DS4ParticlesApp::writeConfig()
 	cOutFile << "particle_size=" << to_string(mParticleSize) << endl;
 	cOutFile << "particle_alpha=" << to_string(mParticleAlpha) << endl;
 	cOutFile << "spawn_level=" << to_string(mSpawnLevel) << endl;
-	cOutFile << "min_age=" << to_string(mAgeMin) << endl;
-	cOutFile << "max_age=" << to_string(mAgeMax) << endl;
+	cOutFile << "min_life=" << to_string(mLifeMin) << endl;
+	cOutFile << "max_life=" << to_string(mLifeMax) << endl;
+	cOutFile << "sim_rate=" << to_string(mSimRate) << endl;
 	cOutFile << "spawn_rate=" << to_string(mFramesSpawn) << endl;
 	cOutFile << "draw_logo=" << to_string(mDrawLogo) << endl;
 	cOutFile << "logo_alpha=" << to_string(mLogoAlpha) << endl;
@@ -499,6 +817,28 @@ void DS4ParticlesApp::writeConfig()
 	cOutFile << "draw_bg=" << to_string(mDrawBackground) << endl;
 	cOutFile << "bg_alpha=" << to_string(mBGAlpha) << endl;
 	cOutFile << "color_mode=" << to_string(static_cast<int>(mColorMode)) << endl;
+	cOutFile << "depth_source=" << mDepthSourceName << endl;
+	cOutFile << "replay_path=" << mReplayPath << endl;
+	cOutFile << "replay_realtime=" << to_string(mReplayRealtime) << endl;
+	cOutFile << "replay_loop=" << to_string(mReplayLoop) << endl;
+	cOutFile << "record_path=" << mRecordPath << endl;
+	cOutFile << "capture_thread=" << to_string(mCaptureThread) << endl;
+	cOutFile << "pipeline_cv=" << to_string(mPipelineCV) << endl;
+	cOutFile << "audio_file=" << mAudioFile << endl;
+	cOutFile << "audio_bands=" << mAudioBands << endl;
+	cOutFile << "onset_threshold=" << to_string(mOnsetThreshold) << endl;
+	cOutFile << "trace_path=" << mTracePath << endl;
+	cOutFile << "trace_on_exit=" << to_string(mTraceOnExit) << endl;
+	cOutFile << "render_path=" << mRenderPath << endl;
+	cOutFile << "point_backend=" << mPointBackendName << endl;
+	cOutFile << "random_seed=" << to_string(mRandomSeed) << endl;
+	cOutFile << "governor=" << to_string(mGovernorOn) << endl;
+	cOutFile << "governor_target_ms=" << to_string(mGovernorTarget) << endl;
+	cOutFile << "governor_cloud_res_max=" << to_string(mGovernorCloudResMax) << endl;
+	cOutFile << "governor_spawner_res_max=" << to_string(mGovernorSpawnResMax) << endl;
+	cOutFile << "governor_bolt_res_max=" << to_string(mGovernorBoltResMax) << endl;
+	cOutFile << "governor_particles_min=" << to_string(mGovernorParticlesMin) << endl;
+	cOutFile << "governor_spawn_rate_max=" << to_string(mGovernorSpawnRateMax) << endl;
 	cOutFile.close();
 }
 #pragma endregion Setup
@@ -507,125 +847,148 @@ void DS4ParticlesApp::writeConfig()
 
 void DS4ParticlesApp::updateAudio()
 {
-	mMagSpectrum = mMonitorSpectralNode->getMagSpectrum();
-	auto cFFTBounds = std::minmax(mMagSpectrum.begin(), mMagSpectrum.end());
-
-	float cSum = 0.0f;
-	float cMax = -1.0f;
-	float cMin = 10000.0f;
-	mMagMean = 0.0f;
-	for (auto cV : mMagSpectrum)
-	{
-		if (cV > cMax)
-			cMax = cV;
-		else if (cV < cMin)
-			cMin = cV;
-		cSum += cV;
-	}
-	
-	if (mMagSpectrum.size() > 0)
+	DS4_TRACE_SCOPE("updateAudio");
+	if (!mAudioFileSamples.empty())
 	{
-		cSum /= (float)mMagSpectrum.size();
-		mMagMean = math<float>::clamp(cSum * 10000, 0, 1);
+		//Catch the file up to the wall clock, skipping ahead after long stalls
+		float cRate = mFileAnalyzer.getSampleRate();
+		size_t cTarget = (size_t)(mAudioFileTimer.getSeconds()*cRate);
+		if (cTarget - mAudioFileFed > cRate)
+			mAudioFileFed = cTarget - (size_t)cRate;
+		while (mAudioFileFed < cTarget)
+		{
+			size_t cPos = mAudioFileFed % mAudioFileSamples.size();
+			size_t cCount = math<size_t>::min(cTarget - mAudioFileFed, mAudioFileSamples.size() - cPos);
+			mFileAnalyzer.process(&mAudioFileSamples[cPos], cCount);
+			mAudioFileFed += cCount;
+		}
+		mAudioFeatures = mFileAnalyzer.getFeatures();
 	}
+	else
+		mAudioFeatures = mAudioNode->getFeatures();
+
+	mMagMean = mAudioFeatures.Level;
+	DS4_TRACE_COUNTER("audio onsets", mAudioFeatures.OnsetCount);
 }
 
 void DS4ParticlesApp::updateCV()
 {
-	int did = 0;
-	mCloudPoints.clear();
-	mBorderPoints.clear();
-	while (did < S_DEPTH_SIZE.x*S_DEPTH_SIZE.y)
+	DS4_TRACE_SCOPE("updateCV");
+	DS4CVParams cParams = getCVParams();
+	uint64_t cFrame = getElapsedFrames();
+	if (mCVPipeline.isRunning())
 	{
-		float cDepthVal = (float)mDepthBuffer[did];
-		if (cDepthVal > mDepthMin&&cDepthVal < mDepthMax)
-			mDepthPixels[did] = (uint8_t)(lmap<float>(cDepthVal, mDepthMin, mDepthMax, 255, 0));
-
-		else
-			mDepthPixels[did] = 0;
-
-		did += 1;
+		//Draws and spawns from the previous frame while this one is processed
+		DS4FrameResultRef cResult = mCVPipeline.submit(mDepthBuffer, cParams, cFrame);
+		if (cResult)
+			mFrameResult = cResult;
+	}
+	else
+	{
+		mDepthProcessor.process(mDepthBuffer, cParams, cFrame);
+		mFrameResult = mDepthProcessor.takeResult(cParams, cFrame);
 	}
-
-	mMatCurrent = cv::Mat(S_DEPTH_SIZE.y, S_DEPTH_SIZE.x, CV_8U(1), mDepthPixels);
-	cv::threshold(mMatCurrent, mMatCurrent, mThresh, 255, CV_THRESH_BINARY);
 
 	if (!mIsDebug)
+		DS4DepthProcessor::emit(mFrameResult->SpawnPoints, mFrameResult->LongSpawnPoints, mParticleSystem, mFrameResult->Params, mFrameResult->FrameNumber);
+
+	if (mIsDebug && !mFrameResult->Mask.empty())
 	{
-		for (int dy = 0; dy < S_DEPTH_SIZE.y; dy++)
-		{
-			for (int dx = 0; dx < S_DEPTH_SIZE.x; dx++)
-			{
-				float cDepthVal = (float)mDepthBuffer[dy*S_DEPTH_SIZE.x + dx];
-				float cInPoint[] = { static_cast<float>(dx), static_cast<float>(dy), cDepthVal }, cOutPoint[3];
-				if ((cDepthVal>mDepthMin&&cDepthVal < mDepthMax) && mMatCurrent.at<uint8_t>(dy, dx)==255)
-				{
-					DSTransformFromZImageToZCamera(mZIntrinsics, cInPoint, cOutPoint);
-					if (dx % mCloudRes == 0 && dy%mCloudRes == 0)
-						mCloudPoints.push_back(Vec3f(cOutPoint[0], -cOutPoint[1], cOutPoint[2]));
-					if (dy >= S_DEPTH_SIZE.y - 2)
-						mBorderPoints.push_back(Vec3f(cOutPoint[0], -cOutPoint[1], cOutPoint[2]));
-				}
-			}
-		}
+		DS4_TRACE_SCOPE("updateCV.textures");
+		updateDebugTexture(mFrameResult->Diff, mChanBlob, mTexBlob);
+		updateDebugTexture(mFrameResult->Mask, mChanBase, mTexBase);
 	}
+}
 
-	mContours.clear();
-	mContourPoints.clear();
+// The channel and texture are only created when the image size changes,
+// every other frame copies into the channel and uploads it in place
+void DS4ParticlesApp::updateDebugTexture(const cv::Mat &pImage, Channel8u &pChannel, gl::Texture &pTexture)
+{
+	if (!pChannel || pChannel.getWidth() != pImage.cols || pChannel.getHeight() != pImage.rows)
+	{
+		pChannel = Channel8u(pImage.cols, pImage.rows);
+		pTexture.reset();
+	}
+	for (int ry = 0; ry < pImage.rows; ++ry)
+		memcpy(pChannel.getData(Vec2i(0, ry)), pImage.ptr<uint8_t>(ry), pImage.cols);
 
-	cv::absdiff(mMatCurrent, mMatPrev, mMatDiff);
-	cv::findContours(mMatDiff, mContours, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
+	if (pTexture)
+		pTexture.update(pChannel, pChannel.getBounds());
+	else
+		pTexture = gl::Texture(pChannel);
+}
 
-	for (auto cContour : mContours)
+// Feeds the last frame's CPU time (updateCV, the sim steps and draw) to the
+// governor and derives this frame's settings from the GUI ones. Turning the
+// governor off goes straight back to the GUI settings. Bolts have always
+// used every contour point whatever Bolt Res says, so level 0 keeps that and
+// only the governor thins them.
+void DS4ParticlesApp::updateGovernor()
+{
+	DS4QualitySettings cBase = { mCloudRes, mSpawnRes, 1, mNumParticles, mFramesSpawn };
+	double cFrameMs = mFrameCpuMs;
+	mFrameCpuMs = 0;
+	if (!mGovernorOn)
 	{
-		if (cv::contourArea(cContour, false) > mSizeMin)
+		if (mGovernor.getLevel() != 0)
+			console() << "Quality governor off, back to the configured settings" << endl;
+		mGovernor.reset();
+	}
+	else
+	{
+		int cLevel = mGovernor.getLevel();
+		mGovernor.setTarget(mGovernorTarget);
+		if (mGovernor.addFrame(cFrameMs))
 		{
-			for (int vi = 0; vi < cContour.size(); vi++)
-			{
-				cv::Point cPoint = cContour[vi];
-				if (mMatPrev.at<uint8_t>(cPoint.y, cPoint.x) == 255)
-				{
-					if (!mIsDebug && (vi % mSpawnRes == 0) && (getElapsedFrames() % mFramesSpawn == 0))
-					{
-						uint16_t cZ = mPrevDepthBuffer[cPoint.y*S_DEPTH_SIZE.x + cPoint.x];
-						if (cZ>mDepthMin&&cZ < mDepthMax)
-						{
-							float cInPoint[] = { static_cast<float>(cPoint.x), static_cast<float>(cPoint.y), cZ }, cOutPoint[3];
-							DSTransformFromZImageToZCamera(mZIntrinsics, cInPoint, cOutPoint);
-							if (mParticleSystem.count() < mNumParticles&&cOutPoint[1] < 50 && mMagMean>mSpawnLevel)
-							{
-								if (vi%20==0)
-									mParticleSystem.add(Vec3f(cOutPoint[0], -cOutPoint[1], cOutPoint[2]), Vec3f(randFloat(-0.15f, 0.15f), randFloat(-1.5f, -5.9f), randFloat(0, -1)), Vec2f(180, 180), mParticleAlpha, (getElapsedFrames()%90==0));
-								else
-									mParticleSystem.add(Vec3f(cOutPoint[0], -cOutPoint[1], cOutPoint[2]), Vec3f(randFloat(-0.15f, 0.15f), randFloat(-2, -6), randFloat(0, -1)), Vec2f(mAgeMin, mAgeMax), mParticleAlpha, false);
-							}
-						}
-					}
-				}
-				if (mMatCurrent.at<uint8_t>(cPoint.y, cPoint.x) == 255)
-				{
-					uint16_t cZ2 = mDepthBuffer[cPoint.y*S_DEPTH_SIZE.x + cPoint.x];
-					if (cZ2 > mDepthMin&&cZ2 < mDepthMax)
-					{
-						float cInPoint2[] = { static_cast<float>(cPoint.x), static_cast<float>(cPoint.y), cZ2 }, cOutPoint2[3];
-						DSTransformFromZImageToZCamera(mZIntrinsics, cInPoint2, cOutPoint2);
-						mContourPoints.push_back(Vec3f(cOutPoint2[0], -cOutPoint2[1], cOutPoint2[2]));
-					}
-				}
-			}
+			DS4QualitySettings cNew = mGovernor.apply(cBase);
+			console() << "Quality level " << cLevel << " -> " << mGovernor.getLevel() << ", " << mGovernor.getWindowMs() << " ms against a " << mGovernorTarget << " ms target: "
+				<< "cloud_res " << cNew.CloudRes << ", spawner_res " << cNew.SpawnRes << ", bolt_res " << cNew.BoltRes
+				<< ", particle_count " << cNew.ParticleCount << ", spawn_rate " << cNew.FramesSpawn << endl;
 		}
 	}
 
-	mMatCurrent.copyTo(mMatPrev);
-	memcpy(mPrevDepthBuffer, mDepthBuffer, (size_t)(S_DEPTH_SIZE.x*S_DEPTH_SIZE.y*sizeof(uint16_t)));
-	if (mIsDebug)
-		mTexBlob = gl::Texture(fromOcv(mMatDiff));
+	mQuality = mGovernor.apply(cBase);
+	mQualityLevel = mGovernor.getLevel();
+	mGovernorMs = mGovernor.getWindowMs();
+	DS4_TRACE_COUNTER("quality level", mQualityLevel);
+}
 
-	if (mIsDebug)
-		mTexBase = gl::Texture(fromOcv(mMatCurrent));
+// Runs however many fixed steps pElapsed seconds add up to at the sim rate,
+// drawing interpolates between the last two
+void DS4ParticlesApp::stepSimulation(double pElapsed)
+{
+	DS4_TRACE_SCOPE("update.sim");
+	mSimClock.setRate(mSimRate);
+	int cSteps = mSimClock.advance(pElapsed);
+	for (int si = 0; si < cSteps; ++si)
+		mParticleSystem.step(mSimClock.getStepSeconds());
+	DS4_TRACE_COUNTER("sim steps", cSteps);
+}
 
-	if (!mIsDebug)
-		mParticleSystem.step();
+DS4CVParams DS4ParticlesApp::getCVParams()
+{
+	DS4CVParams cParams;
+	cParams.DepthMin = mDepthMin;
+	cParams.DepthMax = mDepthMax;
+	cParams.Thresh = mThresh;
+	cParams.SizeMin = mSizeMin;
+	cParams.Denoise = mDenoise;
+	cParams.DenoiseAlpha = mDenoiseAlpha;
+	cParams.DenoiseSnap = mDenoiseSnap;
+	cParams.DenoiseHoleFrames = mDenoiseHoleFrames;
+	cParams.CloudMode = mCloudMode;
+	cParams.VoxelSize = mVoxelSize;
+	cParams.CloudRes = mQuality.CloudRes;
+	cParams.BoltRes = mQuality.BoltRes;
+	cParams.SpawnRes = mQuality.SpawnRes;
+	cParams.FramesSpawn = mQuality.FramesSpawn;
+	cParams.LifeMin = mLifeMin;
+	cParams.LifeMax = mLifeMax;
+	cParams.ParticleAlpha = mParticleAlpha;
+	cParams.SpawnLevel = mSpawnLevel;
+	cParams.Level = mMagMean;
+	cParams.IsDebug = mIsDebug;
+	return cParams;
 }
 
 #pragma endregion Update
@@ -641,39 +1004,47 @@ void DS4ParticlesApp::drawDebug()
 		gl::draw(mTexBase, Rectf(0, 0, getWindowWidth() / 2, getWindowHeight() / 2));
 	if (mTexBlob)
 		gl::draw(mTexBlob, Rectf(0, getWindowHeight() / 2, getWindowWidth() / 2, getWindowHeight()));
-	if (mContours.size() > 0)
+	const vector<vector<cv::Point>> &cContours = mFrameResult->Contours;
+	if (cContours.size() > 0)
 	{
 		gl::pushMatrices();
 		gl::translate(Vec2f(getWindowWidth() / 2, getWindowHeight() / 2));
 		gl::scale(Vec2f((getWindowWidth() / (float)S_DEPTH_SIZE.x)*0.5f, (getWindowHeight() / (float)S_DEPTH_SIZE.y)*0.5f));
+		gl::color(mIntelLightBlue);
+		for (auto &cRegion : mFrameResult->DirtyRegions)
+			gl::drawStrokedRect(Rectf(cRegion.x, cRegion.y, cRegion.x + cRegion.width, cRegion.y + cRegion.height));
 		gl::color(mIntelGreen);
 		gl::begin(GL_POINTS);
 		glPointSize(2.0);
 
-		for (auto cit : mContours)
+		for (auto &cContour : cContours)
 		{
-			for (auto vit : cit)
-				gl::vertex(vit.x, vit.y);
+			for (auto &cPt : cContour)
+				gl::vertex(cPt.x, cPt.y);
 		}
 		gl::end();
 		gl::popMatrices();
 	}
 
-	if (mContours.size() > 0)
+	if (cContours.size() > 0)
 	{
 		gl::pushMatrices();
 		gl::translate(Vec2f(getWindowWidth() / 2, 0));
 		gl::scale(Vec2f((getWindowWidth() / (float)S_DEPTH_SIZE.x)*0.5f, (getWindowHeight() / (float)S_DEPTH_SIZE.y)*0.5f));
 		gl::color(mIntelYellow);
 		
-		for (auto cContour : mContours)
+		//Contours that passed the frame's min_poly_area, with their bounds
+		const DS4ContourAnalysis &cAnalysis = mFrameResult->Analysis;
+		for (size_t ci = 0; ci < cContours.size(); ++ci)
 		{
-			if (cv::contourArea(cContour, false) > mSizeMin)
+			const DS4ContourInfo &cInfo = cAnalysis.Contours[ci];
+			if (cInfo.Passed)
 			{
 				gl::begin(GL_LINE_LOOP);
-				for (auto cPt : cContour)
+				for (auto &cPt : cContours[ci])
 					gl::vertex(cPt.x, cPt.y);
 				gl::end();
+				gl::drawStrokedRect(Rectf(cInfo.Bounds.x, cInfo.Bounds.y, cInfo.Bounds.x + cInfo.Bounds.width, cInfo.Bounds.y + cInfo.Bounds.height));
 			}
 		}
 		gl::popMatrices();
@@ -694,6 +1065,7 @@ void DS4ParticlesApp::drawDebug()
 
 void DS4ParticlesApp::drawRunning()
 {
+	DS4_TRACE_SCOPE("drawRunning");
 	gl::clear(Color::black());
 	gl::color(Color::white());
 	if (mDrawBackground)
@@ -710,46 +1082,9 @@ void DS4ParticlesApp::drawRunning()
 	gl::enableAdditiveBlending();
 	gl::enable(GL_POINT_SIZE);
 
-	//Point Cloud
-	if (mColorMode == COLOR_MODE_BLUE || mColorMode == COLOR_MODE_BLUE_P)
-		gl::color(mIntelDarkBlue);
-	else if (mColorMode == COLOR_MODE_GOLD || mColorMode == COLOR_MODE_GOLD_P)
-		gl::color(mIntelOrange);
-
-	glPointSize(mPointSize);
-	gl::begin(GL_POINTS);
-
-	for (auto pit : mCloudPoints)
-	{
-		gl::vertex(pit);
-	}
-	gl::end();
-
-	//Lightning Bolts
-	float cPointSize = lmap<float>(mMagMean, 0, 1, mBoltWidthMin, mBoltWidthMax);
-	float cAlpha = lmap<float>(mMagMean,0,1,mBoltAlphaMin, mBoltAlphaMax);
-	glPointSize(cPointSize);
-	if (mColorMode == COLOR_MODE_BLUE || mColorMode == COLOR_MODE_GOLD_P)
-		gl::color(ColorA(mIntelPaleBlue.r, mIntelPaleBlue.g, mIntelPaleBlue.b, cAlpha));
-	else if (mColorMode == COLOR_MODE_GOLD || mColorMode == COLOR_MODE_BLUE_P)
-		gl::color(ColorA(mIntelYellow.r, mIntelYellow.g, mIntelYellow.b, cAlpha));
-	gl::begin(GL_POINTS);
-	for (auto pit2 : mContourPoints)
-	{
-		gl::vertex(pit2);
-	}
-	gl::end();
-
-	gl::begin(GL_POINTS);
-	for (auto bpit : mBorderPoints)
-	{
-		gl::vertex(bpit);
-	}
-	gl::end();
-
-	//
-	glPointSize(mParticleSize);
-	mParticleSystem.display();
+	mPointBackend->beginFrame();
+	drawPointLayers(*mPointBackend);
+	DS4_TRACE_COUNTER("point vertices", mPointBackend->getStats().Vertices);
 	gl::popMatrices();
 	//
 	if (mCamInfo)
@@ -783,12 +1118,151 @@ void DS4ParticlesApp::drawCamInfo()
 	gl::drawString(cViewStr, Vec2i(20, 40));
 }
 
+void DS4ParticlesApp::drawPointLayers(DS4PointBackend &pBackend)
+{
+	DS4DrawPointLayers(pBackend, getPointLayerParams(), mFrameResult->CloudPoints, mFrameResult->ContourPoints, mFrameResult->BorderPoints, mParticleSystem, mMagMean, mSimClock.getAlpha());
+}
+
+DS4PointLayerParams DS4ParticlesApp::getPointLayerParams()
+{
+	DS4PointLayerParams cParams;
+	cParams.PointSize = mPointSize;
+	cParams.ParticleSize = mParticleSize;
+	cParams.BoltWidthMin = mBoltWidthMin;
+	cParams.BoltWidthMax = mBoltWidthMax;
+	cParams.BoltAlphaMin = mBoltAlphaMin;
+	cParams.BoltAlphaMax = mBoltAlphaMax;
+	cParams.ColorMode = mColorMode;
+	return cParams;
+}
+
 
 #pragma endregion Draw
 
+#pragma region Recording
+void DS4ParticlesApp::toggleRecording()
+{
+	if (mRecorder.isRecording())
+	{
+		mRecorder.stop();
+		console() << "Recording stopped, " << mRecorder.getFramesWritten() << " frames written, " << mRecorder.getFramesDropped() << " dropped" << endl;
+		return;
+	}
+
+	bfs::path cDir(mRecordPath);
+	bfs::create_directories(cDir);
+	string cFile = (cDir / ("depth_" + to_string(time(nullptr)) + ".ds4r")).string();
+	if (mRecorder.start(cFile, S_DEPTH_SIZE, mZIntrinsics, 60))
+		console() << "Recording depth to " << cFile << endl;
+	else
+		console() << "Unable to record to " << cFile << endl;
+}
+#pragma endregion Recording
+
+#pragma region Soft Render
+// Repeats drawRunning()'s point layers on the CPU and writes the frame to
+// mRenderPath. Background, logo and GUI are not rendered.
+void DS4ParticlesApp::renderSoftFrame()
+{
+	DS4_TRACE_SCOPE("renderSoftFrame");
+	if (mSoftRenderer.getSize() != getWindowSize())
+		mSoftRenderer.setup(getWindowSize());
+
+	const CameraPersp &cCam = mMayaCam.getCamera();
+	Matrix44f cModel = mArcball.getQuat().toMatrix44() * Matrix44f::createScale(Vec3f(-1, 1, 1));
+	mSoftRenderer.setMatrix(cCam.getProjectionMatrix() * cCam.getModelViewMatrix() * cModel);
+	mSoftRenderer.clear();
+	drawPointLayers(mSoftRenderer);
+	mSoftRenderer.resolve();
+
+	bfs::path cDir(mRenderPath);
+	if (mSoftFrame == 0)
+		bfs::create_directories(cDir);
+	ostringstream cName;
+	cName << "frame_" << setw(6) << setfill('0') << mSoftFrame++ << ".png";
+	string cFile = (cDir / cName.str()).string();
+	if (!mSoftRenderer.writeImage(cFile))
+	{
+		console() << "Unable to write " << cFile << ", soft rendering stopped" << endl;
+		mIsSoftRendering = false;
+	}
+}
+#pragma endregion Soft Render
+
+#pragma region Profiling
+// Steps the same particle set with 1..N threads and logs time per step,
+// speedup over one thread and whether the result matches the serial run.
+void DS4ParticlesApp::reportStepScaling()
+{
+	const size_t cCount = 200000;
+	const int cSteps = 100;
+	const float cDt = 1.0f / 60.0f;
+
+	DS4Random cRandom(1, RANDOM_STREAM_PROFILING);
+	DS4ParticleSystem cReference;
+	cReference.setCapacity(cCount);
+	for (size_t pi = 0; pi < cCount; ++pi)
+	{
+		Vec3f cPos(cRandom.nextFloat(-500, 500), cRandom.nextFloat(0, 500), cRandom.nextFloat(500, 1500));
+		Vec3f cVel(cRandom.nextFloat(-9, 9), cRandom.nextFloat(-120, -360), cRandom.nextFloat(0, -60));
+		cReference.add(cPos, cVel, Vec2f(cSteps * 2 * cDt, cSteps * 4 * cDt), mParticleAlpha, false);
+	}
+
+	DS4ParticleSystem cSerial(cReference);
+	cSerial.setWorkerPool(DS4WorkerPoolRef());
+	for (int si = 0; si < cSteps; ++si)
+		cSerial.step(cDt);
+
+	//One pool for every run, only the first ti - 1 workers take part
+	double cBaseMs = 0;
+	size_t cMaxThreads = math<size_t>::max(1, thread::hardware_concurrency());
+	DS4WorkerPoolRef cPool(new DS4WorkerPool(cMaxThreads - 1));
+	console() << "Step scaling, " << cCount << " particles, " << DS4GetKernelName(cReference.getKernelLevel()) << " kernel" << endl;
+	for (size_t ti = 1; ti <= cMaxThreads; ++ti)
+	{
+		DS4ParticleSystem cSystem(cReference);
+		cPool->setActiveWorkers(ti - 1);
+		cSystem.setWorkerPool(ti > 1 ? cPool : DS4WorkerPoolRef());
+
+		Timer cTimer(true);
+		for (int si = 0; si < cSteps; ++si)
+			cSystem.step(cDt);
+		cTimer.stop();
+
+		double cMs = cTimer.getSeconds()*1000.0 / cSteps;
+		if (ti == 1)
+			cBaseMs = cMs;
+		bool cMatch = cSystem.count() == cSerial.count() &&
+			memcmp(cSystem.getPositions(), cSerial.getPositions(), cSerial.count()*sizeof(Vec3f)) == 0 &&
+			memcmp(cSystem.getColors(), cSerial.getColors(), cSerial.count()*sizeof(ColorA)) == 0;
+		console() << "  " << ti << " threads: " << cMs << " ms/step, " << cBaseMs / cMs << "x" << (cMatch ? "" : " (MISMATCH)") << endl;
+	}
+}
+
+// Writes the most recent trace events from every thread as Chrome trace JSON,
+// viewable in chrome://tracing or ui.perfetto.dev.
+void DS4ParticlesApp::dumpTrace()
+{
+	bfs::path cDir(mTracePath);
+	bfs::create_directories(cDir);
+	string cFile = (cDir / ("trace_" + to_string(time(nullptr)) + ".json")).string();
+	if (DS4Trace::dump(cFile))
+		console() << "Trace written to " << cFile << endl;
+	else
+		console() << "Unable to write trace to " << cFile << endl;
+}
+#pragma endregion Profiling
+
 void DS4ParticlesApp::shutdown()
 {
-	mDSAPI->stopCapture();
+	mCVPipeline.stop();
+	mRecorder.stop();
+	mDepthSource->stopCapture();
+	auto cCapture = dynamic_pointer_cast<DS4CaptureThread>(mDepthSource);
+	if (cCapture)
+		console() << "Capture thread: " << cCapture->getFramesCaptured() << " frames captured, " << cCapture->getFramesDropped() << " dropped, " << cCapture->getFramesRepeated() << " updates without a new frame" << endl;
+	if (mTraceOnExit)
+		dumpTrace();
 }
 
 CINDER_APP_NATIVE( DS4ParticlesApp, RendererGl )
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <cstring>
+#include "cinder/CinderMath.h"
+#include "DS4Particle.h"
+#include "DS4PointBackend.h"
+#include "DS4Trace.h"
+
+size_t DS4PointBackend::getPackedSize(size_t pCount, bool pHasColors)
+{
+	return pCount*sizeof(Vec3f) + (pHasColors ? pCount*sizeof(ColorA) : 0);
+}
+
+void DS4PointBackend::pack(uint8_t *pDst, const Vec3f *pPoints, const ColorA *pColors, size_t pCount)
+{
+	memcpy(pDst, pPoints, pCount*sizeof(Vec3f));
+	if (pColors)
+		memcpy(pDst + pCount*sizeof(Vec3f), pColors, pCount*sizeof(ColorA));
+}
+
+void DS4CountingPointBackend::drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize)
+{
+	submit(pPoints, nullptr, pCount);
+}
+
+void DS4CountingPointBackend::drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize)
+{
+	submit(pPoints, pColors, pCount);
+}
+
+void DS4CountingPointBackend::submit(const Vec3f *pPoints, const ColorA *pColors, size_t pCount)
+{
+	if (pCount == 0)
+		return;
+
+	DS4_TRACE_SCOPE("points.submit");
+	size_t cBytes = getPackedSize(pCount, pColors != nullptr);
+	if (mStaging.size() < cBytes)
+		mStaging.resize(cBytes);
+	pack(&mStaging[0], pPoints, pColors, pCount);
+
+	mStats.Draws++;
+	mStats.Vertices += pCount;
+	mStats.Bytes += cBytes;
+}
+
+void DS4DrawPointLayers(DS4PointBackend &pBackend, const DS4PointLayerParams &pParams, const vector<Vec3f> &pCloud, const vector<Vec3f> &pContour, const vector<Vec3f> &pBorder, DS4ParticleSystem &pParticles, float pLevel, float pSimAlpha)
+{
+	//Point Cloud
+	pBackend.drawPoints(pCloud.data(), pCloud.size(), DS4GetCloudColor(pParams.ColorMode), pParams.PointSize);
+
+	//Lightning Bolts
+	float cPointSize = lmap<float>(pLevel, 0, 1, pParams.BoltWidthMin, pParams.BoltWidthMax);
+	float cAlpha = lmap<float>(pLevel, 0, 1, pParams.BoltAlphaMin, pParams.BoltAlphaMax);
+	ColorA cBoltColor = DS4GetBoltColor(pParams.ColorMode, cAlpha);
+	pBackend.drawPoints(pContour.data(), pContour.size(), cBoltColor, cPointSize);
+	pBackend.drawPoints(pBorder.data(), pBorder.size(), cBoltColor, cPointSize);
+
+	//Particles
+	pParticles.display(pBackend, pParams.ParticleSize, pSimAlpha);
+}
+
+ColorA DS4GetCloudColor(DS4PColorMode pMode)
+{
+	if (pMode == COLOR_MODE_GOLD || pMode == COLOR_MODE_GOLD_P)
+		return Color::hex(0xfdb813);	//Intel orange
+	return Color::hex(0x004280);	//Intel dark blue
+}
+
+ColorA DS4GetBoltColor(DS4PColorMode pMode, float pAlpha)
+{
+	if (pMode == COLOR_MODE_GOLD || pMode == COLOR_MODE_BLUE_P)
+		return ColorA(Color::hex(0xffda00), pAlpha);	//Intel yellow
+	return ColorA(Color::hex(0x7ed3f7), pAlpha);	//Intel pale blue
+}
@@ -0,0 +1,88 @@
+#include <cmath>
+#include "DS4QualityGovernor.h"
+
+static const float S_OVER_RATIO = 1.1f;
+static const float S_UNDER_RATIO = 0.75f;
+static const int S_UNDER_WINDOWS = 4;
+
+// pLevel steps of S_MAX_LEVEL from pBase to pLimit, or pBase when it is
+// already past pLimit in the cheap direction (pCheaper > 0 means higher is
+// cheaper)
+static int stepToward(int pBase, int pLimit, int pLevel, int pCheaper)
+{
+	if ((pLimit - pBase)*pCheaper <= 0)
+		return pBase;
+	float cT = pLevel / (float)DS4QualityGovernor::S_MAX_LEVEL;
+	return (int)floor(pBase + (pLimit - pBase)*cT + 0.5f);
+}
+
+DS4QualityGovernor::DS4QualityGovernor()
+{
+	DS4GovernorParams cParams = { 12.0f, { 8, 8, 4, 1000, 6 } };
+	setup(cParams);
+}
+
+void DS4QualityGovernor::setup(const DS4GovernorParams &pParams)
+{
+	mParams = pParams;
+	reset();
+}
+
+void DS4QualityGovernor::reset()
+{
+	mLevel = 0;
+	mUnderWindows = 0;
+	mIsSettling = false;
+	mWindowSum = 0;
+	mWindowFrames = 0;
+	mWindowMs = 0;
+}
+
+bool DS4QualityGovernor::addFrame(double pMs)
+{
+	mWindowSum += pMs;
+	if (++mWindowFrames < S_WINDOW)
+		return false;
+
+	mWindowMs = (float)(mWindowSum / mWindowFrames);
+	mWindowSum = 0;
+	mWindowFrames = 0;
+	if (mIsSettling)
+	{
+		mIsSettling = false;
+		return false;
+	}
+
+	int cLevel = mLevel;
+	if (mWindowMs > mParams.TargetMs*S_OVER_RATIO)
+	{
+		mUnderWindows = 0;
+		if (mLevel < S_MAX_LEVEL)
+			++mLevel;
+	}
+	else if (mWindowMs < mParams.TargetMs*S_UNDER_RATIO)
+	{
+		if (++mUnderWindows >= S_UNDER_WINDOWS && mLevel > 0)
+		{
+			--mLevel;
+			mUnderWindows = 0;
+		}
+	}
+	else
+		mUnderWindows = 0;
+
+	mIsSettling = mLevel != cLevel;
+	return mIsSettling;
+}
+
+DS4QualitySettings DS4QualityGovernor::apply(const DS4QualitySettings &pBase) const
+{
+	const DS4QualitySettings &cLimits = mParams.Limits;
+	DS4QualitySettings cSettings;
+	cSettings.CloudRes = stepToward(pBase.CloudRes, cLimits.CloudRes, mLevel, 1);
+	cSettings.SpawnRes = stepToward(pBase.SpawnRes, cLimits.SpawnRes, mLevel, 1);
+	cSettings.BoltRes = stepToward(pBase.BoltRes, cLimits.BoltRes, mLevel, 1);
+	cSettings.ParticleCount = stepToward(pBase.ParticleCount, cLimits.ParticleCount, mLevel, -1);
+	cSettings.FramesSpawn = stepToward(pBase.FramesSpawn, cLimits.FramesSpawn, mLevel, 1);
+	return cSettings;
+}
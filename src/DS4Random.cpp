@@ -0,0 +1,123 @@
+#include "DS4Random.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define DS4_RANDOM_SSE2
+#include <emmintrin.h>
+#endif
+
+static const float S_FLOAT_SCALE = 1.0f / 16777216.0f;
+
+// Top 24 bits to [0, 1) exactly, then scaled in the same order as the SSE2 path
+static inline float toFloat(uint32_t pBits, float pMin, float pRange)
+{
+	return pMin + pRange * ((float)(pBits >> 8) * S_FLOAT_SCALE);
+}
+
+#ifdef DS4_RANDOM_SSE2
+// One xorshift128 step of all four lanes, the same recurrence as step()
+static inline void stepLanes(__m128i &pX, __m128i &pY, __m128i &pZ, __m128i &pW)
+{
+	__m128i cT = _mm_xor_si128(pX, _mm_slli_epi32(pX, 11));
+	pX = pY;
+	pY = pZ;
+	pZ = pW;
+	pW = _mm_xor_si128(_mm_xor_si128(pW, _mm_srli_epi32(pW, 19)), _mm_xor_si128(cT, _mm_srli_epi32(cT, 8)));
+}
+#endif
+
+DS4Random::DS4Random(uint64_t pSeed, uint64_t pStream)
+{
+	seed(pSeed, pStream);
+}
+
+uint64_t DS4Random::splitMix64(uint64_t &pState)
+{
+	uint64_t cZ = (pState += 0x9E3779B97F4A7C15ull);
+	cZ = (cZ ^ (cZ >> 30)) * 0xBF58476D1CE4E5B9ull;
+	cZ = (cZ ^ (cZ >> 27)) * 0x94D049BB133111EBull;
+	return cZ ^ (cZ >> 31);
+}
+
+void DS4Random::seed(uint64_t pSeed, uint64_t pStream)
+{
+	uint64_t cState = pSeed ^ splitMix64(pStream);
+	for (int li = 0; li < 4; ++li)
+	{
+		uint64_t cA = splitMix64(cState), cB = splitMix64(cState);
+		mX[li] = (uint32_t)cA;
+		mY[li] = (uint32_t)(cA >> 32);
+		mZ[li] = (uint32_t)cB;
+		mW[li] = (uint32_t)(cB >> 32);
+		//xorshift128 never leaves the all zero state
+		if ((mX[li] | mY[li] | mZ[li] | mW[li]) == 0)
+			mX[li] = 1;
+	}
+	mBlockPos = 4;
+}
+
+void DS4Random::step()
+{
+	for (int li = 0; li < 4; ++li)
+	{
+		uint32_t cT = mX[li] ^ (mX[li] << 11);
+		mX[li] = mY[li];
+		mY[li] = mZ[li];
+		mZ[li] = mW[li];
+		mW[li] = mW[li] ^ (mW[li] >> 19) ^ (cT ^ (cT >> 8));
+	}
+	mBlockPos = 0;
+}
+
+uint32_t DS4Random::nextUInt()
+{
+	if (mBlockPos == 4)
+		step();
+	return mW[mBlockPos++];
+}
+
+float DS4Random::nextFloat()
+{
+	return toFloat(nextUInt(), 0.0f, 1.0f);
+}
+
+float DS4Random::nextFloat(float pMin, float pMax)
+{
+	return toFloat(nextUInt(), pMin, pMax - pMin);
+}
+
+// Uses up what is left of the current block, then whole blocks in SSE2
+// registers, then the tail one value at a time
+void DS4Random::fillFloats(float *pDst, size_t pCount, float pMin, float pMax)
+{
+	float cRange = pMax - pMin;
+	size_t fi = 0;
+	for (; fi < pCount && mBlockPos < 4; ++fi)
+		pDst[fi] = toFloat(mW[mBlockPos++], pMin, cRange);
+
+#ifdef DS4_RANDOM_SSE2
+	if (fi + 4 <= pCount)
+	{
+		__m128i cX = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mX));
+		__m128i cY = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mY));
+		__m128i cZ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mZ));
+		__m128i cW = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mW));
+		const __m128 cScale = _mm_set1_ps(S_FLOAT_SCALE);
+		const __m128 cMin = _mm_set1_ps(pMin);
+		const __m128 cRangeV = _mm_set1_ps(cRange);
+		for (; fi + 4 <= pCount; fi += 4)
+		{
+			stepLanes(cX, cY, cZ, cW);
+			__m128 cUnit = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(cW, 8)), cScale);
+			_mm_storeu_ps(pDst + fi, _mm_add_ps(cMin, _mm_mul_ps(cRangeV, cUnit)));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(mX), cX);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(mY), cY);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(mZ), cZ);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(mW), cW);
+		mBlockPos = 4;
+	}
+#endif
+
+	for (; fi < pCount; ++fi)
+		pDst[fi] = toFloat(nextUInt(), pMin, cRange);
+}
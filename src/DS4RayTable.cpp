@@ -0,0 +1,26 @@
+#include "DS4RayTable.h"
+
+DS4RayTable::DS4RayTable() : mSize(0, 0)
+{
+	mIntrinsics.rfx = mIntrinsics.rfy = mIntrinsics.rpx = mIntrinsics.rpy = 0;
+}
+
+bool DS4RayTable::update(Vec2i pSize, const DSCalibIntrinsicsRectified &pIntrinsics)
+{
+	if (pSize == mSize && !mRaysX.empty() &&
+		pIntrinsics.rfx == mIntrinsics.rfx && pIntrinsics.rfy == mIntrinsics.rfy &&
+		pIntrinsics.rpx == mIntrinsics.rpx && pIntrinsics.rpy == mIntrinsics.rpy)
+		return false;
+
+	mSize = pSize;
+	mIntrinsics = pIntrinsics;
+	mRaysX.resize(mSize.x*mSize.y);
+	mRaysY.resize(mSize.y);
+	for (int ry = 0; ry < mSize.y; ++ry)
+	{
+		mRaysY[ry] = (ry - mIntrinsics.rpy) / mIntrinsics.rfy;
+		for (int rx = 0; rx < mSize.x; ++rx)
+			mRaysX[ry*mSize.x + rx] = (rx - mIntrinsics.rpx) / mIntrinsics.rfx;
+	}
+	return true;
+}
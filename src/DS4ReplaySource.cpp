@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <boost/program_options.hpp>
+#include "DS4ReplaySource.h"
+
+namespace bpo = boost::program_options;
+
+static const char *S_INTRINSICS_FILE = "intrinsics.cfg";
+static const char *S_FRAME_EXT = ".raw";
+
+DS4ReplaySource::DS4ReplaySource(const bfs::path &pPath, ReplaySpeed pSpeed, bool pLoop) : mPath(pPath), mSpeed(pSpeed), mLoop(pLoop), mIsRunning(false), mSize(0, 0), mFPS(60), mFrameCount(0), mNextFrame(0), mFrameNumber(0), mStartClock(0), mFrameTime(0)
+{
+	memset(&mIntrinsics, 0, sizeof(mIntrinsics));
+}
+
+bool DS4ReplaySource::startCapture()
+{
+	mFrameFiles.clear();
+	mRecording.close();
+	if (bfs::is_regular_file(mPath))
+	{
+		if (!mRecording.open(mPath.string()))
+			return false;
+		mIntrinsics = mRecording.getIntrinsics();
+		mSize = mRecording.getSize();
+		mFPS = mRecording.getFPS() > 0 ? mRecording.getFPS() : 60.0f;
+		mFrameCount = mRecording.getFrameCount();
+	}
+	else
+	{
+		if (!bfs::is_directory(mPath) || !readIntrinsics())
+			return false;
+
+		for (bfs::directory_iterator cIt(mPath); cIt != bfs::directory_iterator(); ++cIt)
+		{
+			if (bfs::is_regular_file(cIt->status()) && cIt->path().extension() == S_FRAME_EXT)
+				mFrameFiles.push_back(cIt->path());
+		}
+		sort(mFrameFiles.begin(), mFrameFiles.end());
+		mFrameCount = mFrameFiles.size();
+	}
+	if (mFrameCount == 0)
+		return false;
+
+	mFrame.assign(mSize.x*mSize.y, 0);
+	mNextFrame = 0;
+	mFrameNumber = 0;
+	mStartClock = getClock();
+	mIsRunning = true;
+	return true;
+}
+
+void DS4ReplaySource::stopCapture()
+{
+	mIsRunning = false;
+}
+
+bool DS4ReplaySource::grab()
+{
+	if (!mIsRunning)
+		return false;
+
+	//Frames live on a timeline at the recorded rate. In real time mode grab()
+	//waits for the next frame to come due and skips any that fell behind,
+	//the same way a live camera drops frames for a slow reader.
+	uint64_t cFrame = mNextFrame;
+	if (mSpeed == SPEED_REALTIME)
+	{
+		uint64_t cDue = static_cast<uint64_t>((getClock() - mStartClock)*mFPS);
+		if (cDue < mNextFrame)
+			return false;
+		cFrame = cDue;
+	}
+
+	if (cFrame >= mFrameCount && !mLoop)
+		return false;
+	if (!readFrame(static_cast<size_t>(cFrame % mFrameCount)))
+		return false;
+
+	mFrameNumber = cFrame;
+	mFrameTime = cFrame / static_cast<double>(mFPS);
+	mNextFrame = cFrame + 1;
+	return true;
+}
+
+bool DS4ReplaySource::getCalibIntrinsicsZ(DSCalibIntrinsicsRectified &pIntrinsics)
+{
+	if (mSize.x == 0)
+		return false;
+	pIntrinsics = mIntrinsics;
+	return true;
+}
+
+bool DS4ReplaySource::readIntrinsics()
+{
+	ifstream cFile((mPath / S_INTRINSICS_FILE).string().c_str());
+	if (!cFile)
+		return false;
+
+	bpo::options_description cDesc("Intrinsics");
+	bpo::variables_map cVars;
+	cDesc.add_options()
+		("width", bpo::value<int>()->required(), "Width")
+		("height", bpo::value<int>()->required(), "Height")
+		("fps", bpo::value<float>(), "Frame Rate")
+		("rfx", bpo::value<float>()->required(), "Focal Length X")
+		("rfy", bpo::value<float>()->required(), "Focal Length Y")
+		("rpx", bpo::value<float>()->required(), "Principal Point X")
+		("rpy", bpo::value<float>()->required(), "Principal Point Y")
+	;
+
+	try
+	{
+		bpo::store(bpo::parse_config_file(cFile, cDesc), cVars);
+		bpo::notify(cVars);
+	}
+	catch (bpo::error &)
+	{
+		return false;
+	}
+
+	mSize = Vec2i(cVars["width"].as<int>(), cVars["height"].as<int>());
+	mFPS = cVars.count("fps") ? cVars["fps"].as<float>() : 60.0f;
+	mIntrinsics.rfx = cVars["rfx"].as<float>();
+	mIntrinsics.rfy = cVars["rfy"].as<float>();
+	mIntrinsics.rpx = cVars["rpx"].as<float>();
+	mIntrinsics.rpy = cVars["rpy"].as<float>();
+	mIntrinsics.rw = mSize.x;
+	mIntrinsics.rh = mSize.y;
+	return mSize.x > 0 && mSize.y > 0 && mFPS > 0;
+}
+
+bool DS4ReplaySource::readFrame(size_t pIndex)
+{
+	if (mRecording.isOpen())
+		return mRecording.readFrame(pIndex, mFrame.data());
+
+	ifstream cFile(mFrameFiles[pIndex].string().c_str(), ios::binary);
+	cFile.read(reinterpret_cast<char*>(mFrame.data()), mFrame.size()*sizeof(uint16_t));
+	return cFile.gcount() == static_cast<streamsize>(mFrame.size()*sizeof(uint16_t));
+}
+
+double DS4ReplaySource::getClock()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool DS4ReplaySource::writeIntrinsics(const bfs::path &pDir, const DSCalibIntrinsicsRectified &pIntrinsics, float pFPS)
+{
+	bfs::create_directories(pDir);
+	ofstream cFile((pDir / S_INTRINSICS_FILE).string().c_str());
+	cFile << "width=" << pIntrinsics.rw << endl;
+	cFile << "height=" << pIntrinsics.rh << endl;
+	cFile << "fps=" << pFPS << endl;
+	cFile << "rfx=" << pIntrinsics.rfx << endl;
+	cFile << "rfy=" << pIntrinsics.rfy << endl;
+	cFile << "rpx=" << pIntrinsics.rpx << endl;
+	cFile << "rpy=" << pIntrinsics.rpy << endl;
+	return cFile.good();
+}
+
+bool DS4ReplaySource::writeFrame(const bfs::path &pDir, size_t pIndex, const uint16_t *pPixels, Vec2i pSize)
+{
+	ostringstream cName;
+	cName << "frame_" << setw(6) << setfill('0') << pIndex << S_FRAME_EXT;
+	ofstream cFile((pDir / cName.str()).string().c_str(), ios::binary);
+	cFile.write(reinterpret_cast<const char*>(pPixels), pSize.x*pSize.y*sizeof(uint16_t));
+	return cFile.good();
+}
@@ -0,0 +1,35 @@
+#include <cmath>
+#include "cinder/CinderMath.h"
+#include "DS4SimClock.h"
+
+using namespace ci;
+
+DS4SimClock::DS4SimClock() : mAccumulator(0), mMaxSteps(8)
+{
+	setRate(60.0f);
+}
+
+void DS4SimClock::setRate(float pHz)
+{
+	mRate = math<float>::clamp(pHz, 1.0f, 1000.0f);
+	mStepSeconds = 1.0 / mRate;
+}
+
+int DS4SimClock::advance(double pSeconds)
+{
+	if (pSeconds > 0)
+		mAccumulator += pSeconds;
+
+	int cSteps = (int)(mAccumulator / mStepSeconds);
+	if (cSteps > mMaxSteps)
+	{
+		cSteps = mMaxSteps;
+		mAccumulator = fmod(mAccumulator, mStepSeconds);
+	}
+	else
+		mAccumulator -= cSteps*mStepSeconds;
+
+	//Rounding can leave a hair under zero or a whole step
+	mAccumulator = math<double>::clamp(mAccumulator, 0.0, mStepSeconds);
+	return cSteps;
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include "cinder/ImageIo.h"
+#include "cinder/Surface.h"
+#include "DS4SoftRenderer.h"
+#include "DS4Trace.h"
+
+DS4SoftRenderer::DS4SoftRenderer() : mSize(0, 0)
+{
+
+}
+
+void DS4SoftRenderer::setup(Vec2i pSize)
+{
+	mSize = pSize;
+	mAccum.assign(mSize.x*mSize.y * 3, 0);
+	mPixels.assign(mSize.x*mSize.y * 3, 0);
+	mSplats.clear();
+}
+
+void DS4SoftRenderer::clear()
+{
+	fill(mAccum.begin(), mAccum.end(), 0.0f);
+	mSplats.clear();
+	mStats = DS4PointStats();
+}
+
+void DS4SoftRenderer::drawPoints(const Vec3f *pPoints, size_t pCount, const ColorA &pColor, float pPointSize)
+{
+	queue(pPoints, nullptr, pColor, pCount, pPointSize);
+}
+
+void DS4SoftRenderer::drawPoints(const Vec3f *pPoints, const ColorA *pColors, size_t pCount, float pPointSize)
+{
+	queue(pPoints, pColors, ColorA::white(), pCount, pPointSize);
+}
+
+void DS4SoftRenderer::queue(const Vec3f *pPoints, const ColorA *pColors, const ColorA &pColor, size_t pCount, float pPointSize)
+{
+	DS4_TRACE_SCOPE("soft.project");
+	size_t cBase = mSplats.size();
+	mSplats.resize(cBase + pCount);
+
+	//Non-smoothed GL points are squares of the rounded size, covering the
+	//pixels whose centers fall inside
+	int cSize = math<int>::max(1, (int)(pPointSize + 0.5f));
+	float cHalf = cSize*0.5f;
+	const float *m = mMatrix.m;
+	float cWidth = (float)mSize.x, cHeight = (float)mSize.y;
+	parallelFor(pCount, 8192, [&](size_t pBegin, size_t pEnd)
+	{
+		for (size_t pi = pBegin; pi < pEnd; ++pi)
+		{
+			const Vec3f &cP = pPoints[pi];
+			Splat &cSplat = mSplats[cBase + pi];
+			float cX = m[0] * cP.x + m[4] * cP.y + m[8] * cP.z + m[12];
+			float cY = m[1] * cP.x + m[5] * cP.y + m[9] * cP.z + m[13];
+			float cZ = m[2] * cP.x + m[6] * cP.y + m[10] * cP.z + m[14];
+			float cW = m[3] * cP.x + m[7] * cP.y + m[11] * cP.z + m[15];
+
+			//GL drops a point whose center is outside the clip volume
+			if (cW <= 0 || cX < -cW || cX > cW || cY < -cW || cY > cW || cZ < -cW || cZ > cW)
+			{
+				cSplat.X0 = cSplat.X1 = cSplat.Y0 = cSplat.Y1 = 0;
+				continue;
+			}
+
+			float cWinX = (cX / cW + 1.0f)*0.5f*cWidth;
+			float cWinY = (1.0f - cY / cW)*0.5f*cHeight;
+			cSplat.X0 = (int)floor(cWinX - cHalf + 0.5f);
+			cSplat.Y0 = (int)floor(cWinY - cHalf + 0.5f);
+			cSplat.X1 = math<int>::min(cSplat.X0 + cSize, mSize.x);
+			cSplat.Y1 = math<int>::min(cSplat.Y0 + cSize, mSize.y);
+			cSplat.X0 = math<int>::max(cSplat.X0, 0);
+			cSplat.Y0 = math<int>::max(cSplat.Y0, 0);
+
+			const ColorA &cC = pColors ? pColors[pi] : pColor;
+			cSplat.R = cC.r*cC.a;
+			cSplat.G = cC.g*cC.a;
+			cSplat.B = cC.b*cC.a;
+		}
+	});
+
+	mStats.Draws++;
+	mStats.Vertices += pCount;
+}
+
+// Splats are binned into the bands their rows touch with a count and a
+// prefix sum, keeping draw order within each band. Every band then walks
+// only its own list and only touches its own rows, so bands never share a
+// pixel and the result doesn't depend on the thread count.
+void DS4SoftRenderer::resolve()
+{
+	DS4_TRACE_SCOPE("soft.resolve");
+	size_t cBands = mWorkerPool ? mWorkerPool->getThreadCount() * 4 : 1;
+	int cBandRows = math<int>::max(1, (int)((mSize.y + cBands - 1) / cBands));
+
+	{
+		DS4_TRACE_SCOPE("soft.bin");
+		mBandStarts.assign(cBands + 1, 0);
+		for (auto &cSplat : mSplats)
+		{
+			if (cSplat.X0 >= cSplat.X1 || cSplat.Y0 >= cSplat.Y1)
+				continue;
+			for (int bi = cSplat.Y0 / cBandRows; bi <= (cSplat.Y1 - 1) / cBandRows; ++bi)
+				++mBandStarts[bi + 1];
+		}
+		for (size_t bi = 0; bi < cBands; ++bi)
+			mBandStarts[bi + 1] += mBandStarts[bi];
+
+		mBandSplats.resize(mBandStarts[cBands]);
+		mBandFill.assign(mBandStarts.begin(), mBandStarts.end() - 1);
+		for (size_t si = 0; si < mSplats.size(); ++si)
+		{
+			const Splat &cSplat = mSplats[si];
+			if (cSplat.X0 >= cSplat.X1 || cSplat.Y0 >= cSplat.Y1)
+				continue;
+			for (int bi = cSplat.Y0 / cBandRows; bi <= (cSplat.Y1 - 1) / cBandRows; ++bi)
+				mBandSplats[mBandFill[bi]++] = (uint32_t)si;
+		}
+	}
+
+	parallelFor(cBands, 1, [&](size_t pBegin, size_t pEnd)
+	{
+		for (size_t bi = pBegin; bi < pEnd; ++bi)
+		{
+			int cRowBegin = (int)bi*cBandRows;
+			int cRowEnd = math<int>::min(cRowBegin + cBandRows, mSize.y);
+			for (size_t ii = mBandStarts[bi]; ii < mBandStarts[bi + 1]; ++ii)
+			{
+				const Splat &cSplat = mSplats[mBandSplats[ii]];
+				int cY0 = math<int>::max(cSplat.Y0, cRowBegin);
+				int cY1 = math<int>::min(cSplat.Y1, cRowEnd);
+				for (int py = cY0; py < cY1; ++py)
+				{
+					float *cRow = &mAccum[(py*mSize.x + cSplat.X0) * 3];
+					for (int px = cSplat.X0; px < cSplat.X1; ++px)
+					{
+						cRow[0] += cSplat.R;
+						cRow[1] += cSplat.G;
+						cRow[2] += cSplat.B;
+						cRow += 3;
+					}
+				}
+			}
+
+			for (int ci = cRowBegin*mSize.x * 3; ci < cRowEnd*mSize.x * 3; ++ci)
+				mPixels[ci] = (uint8_t)(math<float>::min(mAccum[ci], 1.0f)*255.0f + 0.5f);
+		}
+	});
+}
+
+bool DS4SoftRenderer::writeImage(const string &pPath)
+{
+	DS4_TRACE_SCOPE("soft.write");
+	try
+	{
+		Surface8u cSurface(&mPixels[0], mSize.x, mSize.y, mSize.x * 3, SurfaceChannelOrder::RGB);
+		ci::writeImage(pPath, cSurface);
+	}
+	catch (...)
+	{
+		return false;
+	}
+	return true;
+}
+
+void DS4SoftRenderer::parallelFor(size_t pCount, size_t pChunkSize, const DS4RangeTask &pTask)
+{
+	if (mWorkerPool)
+		mWorkerPool->parallelFor(pCount, pChunkSize, pTask);
+	else
+		pTask(0, pCount);
+}
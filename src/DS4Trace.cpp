@@ -0,0 +1,198 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "DS4Trace.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef _MSC_VER
+#define DS4_THREAD_LOCAL __declspec(thread)
+#else
+#define DS4_THREAD_LOCAL __thread
+#endif
+
+static const size_t S_RING_SIZE = 1 << 16;
+
+struct DS4TraceBuffer
+{
+	DS4TraceEvent Events[S_RING_SIZE];
+	atomic<uint64_t> Head;
+	uint32_t ThreadId;
+	const char *ThreadName;
+	bool InUse;		//false once its thread released it, free for the next one
+};
+
+static mutex sRegistryMutex;
+static vector<unique_ptr<DS4TraceBuffer>> sBuffers;
+static atomic<bool> sEnabled(true);
+static DS4_THREAD_LOCAL DS4TraceBuffer *sThreadBuffer = nullptr;
+static DS4_THREAD_LOCAL const char *sThreadName = nullptr;
+
+// Registration is the only locked path, taken once per thread. A released
+// ring is reused before a new one is allocated; it keeps its thread id, so
+// dump() never shows two live threads under one id.
+static DS4TraceBuffer* getThreadBuffer()
+{
+	if (!sThreadBuffer)
+	{
+		lock_guard<mutex> cLock(sRegistryMutex);
+		for (auto &cBuffer : sBuffers)
+		{
+			if (!cBuffer->InUse)
+			{
+				sThreadBuffer = cBuffer.get();
+				break;
+			}
+		}
+		if (!sThreadBuffer)
+		{
+			sBuffers.push_back(unique_ptr<DS4TraceBuffer>(new DS4TraceBuffer()));
+			sThreadBuffer = sBuffers.back().get();
+			sThreadBuffer->ThreadId = static_cast<uint32_t>(sBuffers.size());
+		}
+		sThreadBuffer->Head = 0;
+		sThreadBuffer->ThreadName = sThreadName;
+		sThreadBuffer->InUse = true;
+	}
+	return sThreadBuffer;
+}
+
+static void push(const DS4TraceEvent &pEvent)
+{
+	DS4TraceBuffer *cBuffer = getThreadBuffer();
+	uint64_t cHead = cBuffer->Head.load(memory_order_relaxed);
+	cBuffer->Events[cHead % S_RING_SIZE] = pEvent;
+	cBuffer->Head.store(cHead + 1, memory_order_release);
+}
+
+static double ticksToMicros(uint64_t pTicks)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER sFrequency = { 0 };
+	if (sFrequency.QuadPart == 0)
+		QueryPerformanceFrequency(&sFrequency);
+	return pTicks * 1000000.0 / sFrequency.QuadPart;
+#else
+	return pTicks / 1000.0;
+#endif
+}
+
+void DS4Trace::setEnabled(bool pEnabled)
+{
+	sEnabled = pEnabled;
+}
+
+bool DS4Trace::isEnabled()
+{
+	return sEnabled;
+}
+
+uint64_t DS4Trace::now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER cCounter;
+	QueryPerformanceCounter(&cCounter);
+	return static_cast<uint64_t>(cCounter.QuadPart);
+#else
+	return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void DS4Trace::scope(const char *pName, uint64_t pStart, uint64_t pEnd)
+{
+	if (!sEnabled)
+		return;
+	DS4TraceEvent cEvent = { pName, pStart, pEnd - pStart, 0, EVENT_SCOPE };
+	push(cEvent);
+}
+
+void DS4Trace::counter(const char *pName, int64_t pValue)
+{
+	if (!sEnabled)
+		return;
+	DS4TraceEvent cEvent = { pName, now(), 0, pValue, EVENT_COUNTER };
+	push(cEvent);
+}
+
+void DS4Trace::setThreadName(const char *pName)
+{
+	sThreadName = pName;
+	if (sThreadBuffer)
+	{
+		lock_guard<mutex> cLock(sRegistryMutex);
+		sThreadBuffer->ThreadName = pName;
+	}
+}
+
+void DS4Trace::releaseThread()
+{
+	if (!sThreadBuffer)
+		return;
+	lock_guard<mutex> cLock(sRegistryMutex);
+	sThreadBuffer->InUse = false;
+	sThreadBuffer = nullptr;
+}
+
+bool DS4Trace::dump(const string &pPath)
+{
+	ofstream cFile(pPath.c_str());
+	if (!cFile)
+		return false;
+
+	cFile << "{\"traceEvents\":[\n";
+	bool cFirst = true;
+
+	lock_guard<mutex> cLock(sRegistryMutex);
+	for (auto &cBuffer : sBuffers)
+	{
+		if (!cBuffer->InUse)
+			continue;
+		if (cBuffer->ThreadName)
+		{
+			cFile << (cFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << cBuffer->ThreadId
+				<< ",\"args\":{\"name\":\"" << cBuffer->ThreadName << "\"}}";
+			cFirst = false;
+		}
+
+		//The owning thread keeps writing while we read, so copy the ring and
+		//then drop anything it may have overwritten during the copy. The
+		//slot at cHeadAfter may be mid-write, so the oldest safe one is the
+		//slot after it.
+		uint64_t cHead = cBuffer->Head.load(memory_order_acquire);
+		uint64_t cBegin = cHead > S_RING_SIZE ? cHead - S_RING_SIZE : 0;
+		vector<DS4TraceEvent> cEvents;
+		cEvents.reserve(static_cast<size_t>(cHead - cBegin));
+		for (uint64_t ei = cBegin; ei < cHead; ++ei)
+			cEvents.push_back(cBuffer->Events[ei % S_RING_SIZE]);
+		uint64_t cHeadAfter = cBuffer->Head.load(memory_order_acquire);
+		uint64_t cValidBegin = cHeadAfter >= S_RING_SIZE ? cHeadAfter - S_RING_SIZE + 1 : 0;
+
+		for (uint64_t ei = cBegin; ei < cHead; ++ei)
+		{
+			if (ei < cValidBegin)
+				continue;
+			const DS4TraceEvent &cEvent = cEvents[static_cast<size_t>(ei - cBegin)];
+			cFile << (cFirst ? "" : ",\n");
+			cFirst = false;
+			if (cEvent.Type == EVENT_COUNTER)
+			{
+				cFile << "{\"name\":\"" << cEvent.Name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << cBuffer->ThreadId
+					<< ",\"ts\":" << fixed << ticksToMicros(cEvent.Start)
+					<< ",\"args\":{\"value\":" << cEvent.Value << "}}";
+			}
+			else
+			{
+				cFile << "{\"name\":\"" << cEvent.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << cBuffer->ThreadId
+					<< ",\"ts\":" << fixed << ticksToMicros(cEvent.Start)
+					<< ",\"dur\":" << ticksToMicros(cEvent.Duration) << "}";
+			}
+		}
+	}
+
+	cFile << "\n]}\n";
+	return cFile.good();
+}
@@ -0,0 +1,99 @@
+#include <cmath>
+#include "cinder/CinderMath.h"
+#include "DS4VoxelGrid.h"
+
+static const uint32_t S_INITIAL_BITS = 16;
+
+DS4VoxelGrid::DS4VoxelGrid() : mVoxelSize(0), mInvVoxelSize(0), mGeneration(0), mShift(64 - S_INITIAL_BITS)
+{
+	Slot cEmpty = { 0, 0, 0, 0, 0, 0 };
+	mSlots.assign((size_t)1 << S_INITIAL_BITS, cEmpty);
+	setVoxelSize(15.0f);
+}
+
+void DS4VoxelGrid::setVoxelSize(float pSize)
+{
+	mVoxelSize = math<float>::max(pSize, 1.0f);
+	mInvVoxelSize = 1.0f / mVoxelSize;
+}
+
+void DS4VoxelGrid::begin()
+{
+	mOccupied.clear();
+	if (++mGeneration == 0)
+	{
+		for (auto &cSlot : mSlots)
+			cSlot.Generation = 0;
+		mGeneration = 1;
+	}
+}
+
+// 21 bits per axis covers +-1M voxels, far past the sensor's range
+uint64_t DS4VoxelGrid::pack(int pX, int pY, int pZ)
+{
+	return ((uint64_t)(pX & 0x1fffff) << 42) | ((uint64_t)(pY & 0x1fffff) << 21) | (uint64_t)(pZ & 0x1fffff);
+}
+
+// Fibonacci hashing spreads neighbouring voxels across the table, then
+// probes linearly to the key's slot or the first empty one
+uint32_t DS4VoxelGrid::find(uint64_t pKey) const
+{
+	uint32_t cMask = (uint32_t)mSlots.size() - 1;
+	uint32_t cId = (uint32_t)((pKey * 0x9E3779B97F4A7C15ull) >> mShift);
+	while (mSlots[cId].Generation == mGeneration && mSlots[cId].Key != pKey)
+		cId = (cId + 1) & cMask;
+	return cId;
+}
+
+void DS4VoxelGrid::add(const Vec3f &pPoint)
+{
+	uint64_t cKey = pack((int)floor(pPoint.x*mInvVoxelSize), (int)floor(pPoint.y*mInvVoxelSize), (int)floor(pPoint.z*mInvVoxelSize));
+	uint32_t cId = find(cKey);
+	Slot &cSlot = mSlots[cId];
+	if (cSlot.Generation != mGeneration)
+	{
+		cSlot.Key = cKey;
+		cSlot.Generation = mGeneration;
+		cSlot.Count = 0;
+		cSlot.SumX = cSlot.SumY = cSlot.SumZ = 0;
+		mOccupied.push_back(cId);
+	}
+	cSlot.Count++;
+	cSlot.SumX += pPoint.x;
+	cSlot.SumY += pPoint.y;
+	cSlot.SumZ += pPoint.z;
+
+	//Keep the load under one half so probes stay short
+	if (mOccupied.size() * 2 > mSlots.size())
+		grow();
+}
+
+void DS4VoxelGrid::getPoints(vector<Vec3f> &pPoints) const
+{
+	size_t cBase = pPoints.size();
+	pPoints.resize(cBase + mOccupied.size());
+	for (size_t oi = 0; oi < mOccupied.size(); ++oi)
+	{
+		const Slot &cSlot = mSlots[mOccupied[oi]];
+		float cScale = 1.0f / cSlot.Count;
+		pPoints[cBase + oi] = Vec3f(cSlot.SumX*cScale, cSlot.SumY*cScale, cSlot.SumZ*cScale);
+	}
+}
+
+// Doubles the table and reinserts this generation's voxels in first-hit
+// order, so getPoints() order is unchanged
+void DS4VoxelGrid::grow()
+{
+	vector<Slot> cOld;
+	cOld.swap(mSlots);
+	Slot cEmpty = { 0, 0, 0, 0, 0, 0 };
+	mSlots.assign(cOld.size() * 2, cEmpty);
+	mShift--;
+
+	for (auto &cId : mOccupied)
+	{
+		const Slot &cSlot = cOld[cId];
+		cId = find(cSlot.Key);
+		mSlots[cId] = cSlot;
+	}
+}
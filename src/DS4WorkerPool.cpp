@@ -0,0 +1,120 @@
+#include "DS4WorkerPool.h"
+#include "DS4Trace.h"
+
+DS4WorkerPool::DS4WorkerPool(size_t pWorkers) : mTask(nullptr), mCount(0), mChunkSize(0), mChunkCount(0), mBusy(0), mActiveWorkers(0), mGeneration(0), mQuit(false)
+{
+	mNextChunk = 0;
+	if (pWorkers == 0)
+	{
+		unsigned cHardware = thread::hardware_concurrency();
+		pWorkers = cHardware > 1 ? cHardware - 1 : 0;
+	}
+
+	for (size_t wi = 0; wi < pWorkers; ++wi)
+		mThreads.push_back(thread(&DS4WorkerPool::workerLoop, this, wi));
+	mActiveWorkers = mThreads.size();
+}
+
+DS4WorkerPool::~DS4WorkerPool()
+{
+	{
+		lock_guard<mutex> cLock(mMutex);
+		mQuit = true;
+	}
+	mWakeCond.notify_all();
+	for (auto &cThread : mThreads)
+		cThread.join();
+}
+
+void DS4WorkerPool::parallelFor(size_t pCount, size_t pChunkSize, const DS4RangeTask &pTask)
+{
+	if (pCount == 0)
+		return;
+	if (pChunkSize == 0)
+		pChunkSize = 1;
+
+	size_t cChunkCount = (pCount + pChunkSize - 1) / pChunkSize;
+	if (mActiveWorkers == 0 || cChunkCount == 1)
+	{
+		pTask(0, pCount);
+		return;
+	}
+
+	unique_lock<mutex> cCallLock(mCallMutex, try_to_lock);
+	if (!cCallLock.owns_lock())
+	{
+		pTask(0, pCount);
+		return;
+	}
+
+	{
+		lock_guard<mutex> cLock(mMutex);
+		mTask = &pTask;
+		mCount = pCount;
+		mChunkSize = pChunkSize;
+		mChunkCount = cChunkCount;
+		mNextChunk = 0;
+		mBusy = mThreads.size();
+		++mGeneration;
+	}
+	mWakeCond.notify_all();
+
+	runChunks();
+
+	DS4_TRACE_SCOPE("pool.wait");
+	unique_lock<mutex> cLock(mMutex);
+	mDoneCond.wait(cLock, [this]{ return mBusy == 0; });
+	mTask = nullptr;
+}
+
+void DS4WorkerPool::setActiveWorkers(size_t pWorkers)
+{
+	lock_guard<mutex> cCallLock(mCallMutex);
+	lock_guard<mutex> cLock(mMutex);
+	mActiveWorkers = pWorkers < mThreads.size() ? pWorkers : mThreads.size();
+}
+
+// Parked workers still wake for every call and count themselves done, so
+// parallelFor() needs no second bookkeeping path for them
+void DS4WorkerPool::workerLoop(size_t pIndex)
+{
+	DS4Trace::setThreadName("DS4 worker");
+	uint64_t cSeen = 0;
+	for (;;)
+	{
+		bool cActive;
+		{
+			unique_lock<mutex> cLock(mMutex);
+			mWakeCond.wait(cLock, [&]{ return mQuit || mGeneration != cSeen; });
+			if (mQuit)
+			{
+				DS4Trace::releaseThread();
+				return;
+			}
+			cSeen = mGeneration;
+			cActive = pIndex < mActiveWorkers;
+		}
+
+		if (cActive)
+			runChunks();
+
+		lock_guard<mutex> cLock(mMutex);
+		if (--mBusy == 0)
+			mDoneCond.notify_one();
+	}
+}
+
+void DS4WorkerPool::runChunks()
+{
+	for (;;)
+	{
+		size_t cChunk = mNextChunk.fetch_add(1);
+		if (cChunk >= mChunkCount)
+			return;
+
+		size_t cBegin = cChunk*mChunkSize;
+		size_t cEnd = cBegin + mChunkSize < mCount ? cBegin + mChunkSize : mCount;
+		DS4_TRACE_SCOPE("pool.chunk");
+		(*mTask)(cBegin, cEnd);
+	}
+}